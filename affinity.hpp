@@ -0,0 +1,329 @@
+/**
+ * @file affinity.hpp
+ */
+
+/*
+ * The following license applies to the code in this file:
+ *
+ * **************************************************************************
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * **************************************************************************
+ *
+ * Author: Dr. Rüdiger Berlich of Gemfony scientific UG (haftungsbeschraenkt)
+ * See http://www.gemfony.eu for further information.
+ *
+ * This code is based on the Beast Websocket library by Vinnie Falco.
+ */
+
+#pragma once
+
+/******************************************************************************************/
+/*
+ * Placement of threads on cores and NUMA nodes. Each thread role (io threads, producers, the
+ * threads of a client) may be given a list of cores, and thread i of the role is then pinned
+ * to the i-th core of the list. Alternatively, threads are spread over the NUMA nodes, each
+ * thread being allowed on all cores of its node. Memory is allocated by Linux on the node of
+ * the thread touching it first, so pinned producers create their payloads on their own node.
+ * The topology is read from sysfs, so no libnuma is needed. On other systems, or without
+ * sysfs, all allowed cores are treated as a single node.
+ */
+
+// Standard headers go here
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Boost headers go here
+#include <boost/filesystem.hpp>
+
+// Our own headers go here
+// Nothing
+
+/******************************************************************************************/
+
+/** @brief The placement of the threads of a server */
+struct affinity_settings {
+    std::string io_cores; ///< Cores of the io threads, e.g. "0-3,8". Empty leaves them to the scheduler
+    std::string producer_cores; ///< Cores of the producer threads
+    bool numa = false; ///< Spread the threads of roles without a core list over the NUMA nodes
+};
+
+/******************************************************************************************/
+
+/** @brief Parses a core list such as "0-3,8,10-11", as used by taskset and sysfs */
+inline std::vector<unsigned>
+parse_core_list(const std::string &list) {
+    std::vector<unsigned> cores;
+    std::istringstream items(list);
+    std::string item;
+
+    while (std::getline(items, item, ',')) {
+        item.erase(std::remove_if(item.begin(), item.end(), [](char c) { return std::isspace(static_cast<unsigned char>(c)); }), item.end());
+        if (item.empty()) continue;
+
+        try {
+            auto dash = item.find('-');
+            std::size_t pos = 0;
+            auto first = std::stoul(item.substr(0, dash), &pos);
+            auto last = first;
+            if (std::string::npos != dash) last = std::stoul(item.substr(dash + 1), &pos);
+            if (last < first || last > 4095) throw std::out_of_range(item);
+            for (auto core = first; core <= last; core++) cores.push_back(static_cast<unsigned>(core));
+        } catch (const std::logic_error &) {
+            throw std::runtime_error(R"(parse_core_list(): Invalid entry ")" + item + R"(" in core list ")" + list + R"(")");
+        }
+    }
+
+    return cores;
+}
+
+/******************************************************************************************/
+
+/** @brief Renders a core list in the format accepted by parse_core_list() */
+inline std::string
+core_list_string(const std::vector<unsigned> &cores) {
+    std::ostringstream o;
+    for (std::size_t i = 0; i < cores.size();) {
+        auto j = i;
+        while (j + 1 < cores.size() && cores[j + 1] == cores[j] + 1) j++;
+        if (i > 0) o << ',';
+        o << cores[i];
+        if (j > i) o << '-' << cores[j];
+        i = j + 1;
+    }
+    return o.str();
+}
+
+/******************************************************************************************/
+
+/** @brief The cores the calling thread may run on. Empty if this cannot be determined */
+inline std::vector<unsigned>
+current_thread_cores() {
+    std::vector<unsigned> cores;
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (0 == pthread_getaffinity_np(pthread_self(), sizeof(set), &set)) {
+        for (unsigned core = 0; core < CPU_SETSIZE; core++) {
+            if (CPU_ISSET(core, &set)) cores.push_back(core);
+        }
+    }
+#endif
+    return cores;
+}
+
+/******************************************************************************************/
+
+/** @brief Restricts the calling thread to the given cores. Returns false if this failed or is unsupported */
+inline bool
+pin_current_thread(const std::vector<unsigned> &cores) {
+    if (cores.empty()) return false;
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto core: cores) {
+        if (core < CPU_SETSIZE) CPU_SET(core, &set);
+    }
+    return 0 == pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    return false;
+#endif
+}
+
+/******************************************************************************************/
+////////////////////////////////////////////////////////////////////////////////////////////
+/******************************************************************************************/
+/**
+ * The NUMA nodes of this machine and their cores, restricted to the cores this process may
+ * use. Read from /sys/devices/system/node.
+ */
+class cpu_topology {
+public:
+    //--------------------------------------------------------------------------
+
+    cpu_topology() {
+        auto allowed = current_thread_cores();
+        if (allowed.empty()) {
+            for (unsigned core = 0; core < std::max(1u, std::thread::hardware_concurrency()); core++) allowed.push_back(core);
+        }
+
+        std::vector<std::pair<unsigned, std::vector<unsigned>>> nodes;
+        boost::system::error_code ec;
+        for (const auto &entry: boost::filesystem::directory_iterator("/sys/devices/system/node", ec)) {
+            auto name = entry.path().filename().string();
+            if (name.size() < 5 || 0 != name.compare(0, 4, "node")
+                || !std::all_of(name.begin() + 4, name.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)); })) continue;
+
+            std::ifstream cpulist((entry.path() / "cpulist").string());
+            std::string list;
+            if (!std::getline(cpulist, list)) continue;
+
+            std::vector<unsigned> cores;
+            for (auto core: parse_core_list(list)) {
+                if (std::binary_search(allowed.begin(), allowed.end(), core)) cores.push_back(core);
+            }
+            if (!cores.empty()) nodes.emplace_back(static_cast<unsigned>(std::stoul(name.substr(4))), std::move(cores));
+        }
+
+        std::sort(nodes.begin(), nodes.end());
+        for (auto &node: nodes) {
+            m_node_ids.push_back(node.first);
+            m_node_cores.push_back(std::move(node.second));
+        }
+
+        // No sysfs: All cores form a single node
+        if (m_node_cores.empty()) {
+            m_node_ids.push_back(0);
+            m_node_cores.push_back(allowed);
+        }
+    }
+
+    //--------------------------------------------------------------------------
+
+    [[nodiscard]] std::size_t n_nodes() const { return m_node_cores.size(); }
+
+    [[nodiscard]] const std::vector<unsigned> &cores_of(std::size_t node) const { return m_node_cores.at(node); }
+
+    /** @brief The position of the node holding a core in our list of nodes, or n_nodes() if there is none */
+    [[nodiscard]] std::size_t node_of(unsigned core) const {
+        for (std::size_t node = 0; node < m_node_cores.size(); node++) {
+            if (std::binary_search(m_node_cores[node].begin(), m_node_cores[node].end(), core)) return node;
+        }
+        return m_node_cores.size();
+    }
+
+    //--------------------------------------------------------------------------
+
+    void report(std::ostream &o) const {
+        o << "cpu_topology: " << m_node_cores.size() << " NUMA node(s):";
+        for (std::size_t node = 0; node < m_node_cores.size(); node++) {
+            o << " node " << m_node_ids[node] << " (cores " << core_list_string(m_node_cores[node]) << ")";
+        }
+        o << std::endl;
+    }
+
+private:
+    //--------------------------------------------------------------------------
+    // Data
+
+    std::vector<unsigned> m_node_ids; ///< The sysfs numbers of the nodes
+    std::vector<std::vector<unsigned>> m_node_cores; ///< The usable cores of each node, sorted
+};
+
+/******************************************************************************************/
+////////////////////////////////////////////////////////////////////////////////////////////
+/******************************************************************************************/
+/**
+ * Decides where the threads of one role run. With a core list, thread i is pinned to the i-th
+ * core of the list (round-robin if there are more threads than cores). With NUMA placement,
+ * thread i may run on all cores of node i (round-robin over the nodes). Otherwise, threads
+ * are left to the scheduler.
+ */
+class thread_placement {
+public:
+    //--------------------------------------------------------------------------
+
+    thread_placement() = default;
+
+    thread_placement(
+            std::string role
+            , const std::string &core_list
+            , bool numa
+            , const cpu_topology &topology
+    )
+            : m_role(std::move(role))
+            , m_cores(parse_core_list(core_list))
+    {
+        if (m_cores.empty() && numa && topology.n_nodes() > 1) {
+            for (std::size_t node = 0; node < topology.n_nodes(); node++) m_node_cores.push_back(topology.cores_of(node));
+        }
+
+        for (auto core: m_cores) {
+            if (topology.node_of(core) == topology.n_nodes()) {
+                throw std::runtime_error("thread_placement: Core " + std::to_string(core) + " of the " + m_role + " threads is not available");
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+
+    [[nodiscard]] bool enabled() const { return !m_cores.empty() || !m_node_cores.empty(); }
+
+    [[nodiscard]] bool uses_core_list() const { return !m_cores.empty(); }
+
+    /** @brief The cores thread i of this role may run on. Empty if it is left to the scheduler */
+    [[nodiscard]] std::vector<unsigned> cores_for(std::size_t i) const {
+        if (!m_cores.empty()) return {m_cores[i % m_cores.size()]};
+        if (!m_node_cores.empty()) return m_node_cores[i % m_node_cores.size()];
+        return {};
+    }
+
+    /** @brief Pins the calling thread as thread i of this role */
+    void pin(std::size_t i) const {
+        if (!enabled()) return;
+        if (!pin_current_thread(cores_for(i))) {
+            std::cerr << "thread_placement: Could not pin " << m_role << " thread " << i << " to cores " << core_list_string(cores_for(i)) << std::endl;
+        }
+    }
+
+    //--------------------------------------------------------------------------
+
+    void report(std::ostream &o, std::size_t n_threads) const {
+        o << "thread_placement: " << m_role << " threads: ";
+        if (!enabled()) {
+            o << "not pinned" << std::endl;
+            return;
+        }
+
+        for (std::size_t i = 0; i < n_threads; i++) {
+            o << (i > 0 ? ", " : "") << i << " -> " << core_list_string(cores_for(i));
+        }
+        o << (m_cores.empty() ? " (NUMA nodes)" : "") << std::endl;
+    }
+
+private:
+    //--------------------------------------------------------------------------
+    // Data
+
+    std::string m_role;
+    std::vector<unsigned> m_cores; ///< The core of each thread, if a core list was given
+    std::vector<std::vector<unsigned>> m_node_cores; ///< The cores of each node, for NUMA placement
+};
+
+/******************************************************************************************/
@@ -55,6 +55,13 @@
 #include <thread>
 #include <vector>
 #include <cassert>
+#include <limits>
+#include <optional>
+#include <cmath>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <csignal>
 
 // Boost headers go here
 #include <boost/spirit/include/qi.hpp>
@@ -85,20 +92,32 @@
 #include <boost/filesystem/fstream.hpp>
 #include <boost/lockfree/queue.hpp>
 #include <boost/lockfree/policies.hpp>
+#if defined(ESTRAY_COROUTINES)
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#if !defined(BOOST_ASIO_HAS_CO_AWAIT)
+#error "ESTRAY_COROUTINES requires a compiler with C++20 coroutines"
+#endif
+#endif
 
 // Our own headers go here
 #include "payload.hpp"
-
-/******************************************************************************************/
-////////////////////////////////////////////////////////////////////////////////////////////
-/******************************************************************************************/
-
-namespace beast = boost::beast;         // from <boost/beast.hpp>
-namespace http = beast::http;           // from <boost/beast/http.hpp>
-namespace websocket = beast::websocket; // from <boost/beast/websocket.hpp>
-namespace net = boost::asio;            // from <boost/asio.hpp>
-
-using tcp = net::ip::tcp;       // from <boost/asio/ip/tcp.hpp>
+#include "transport.hpp"
+#include "compression.hpp"
+#include "fast_random.hpp"
+#include "workload.hpp"
+#include "spool.hpp"
+#include "result_sink.hpp"
+#include "distributed_sort.hpp"
+#include "granularity.hpp"
+#include "inflight.hpp"
+#include "client_registry.hpp"
+#include "handler_memory.hpp"
+#include "affinity.hpp"
+#include "spill.hpp"
+#include "broker.hpp"
 
 /******************************************************************************************/
 ////////////////////////////////////////////////////////////////////////////////////////////
@@ -109,6 +128,22 @@ fail(beast::error_code ec, char const *what) {
     std::cerr << what << ": " << ec.message() << "\n";
 }
 
+#if defined(ESTRAY_COROUTINES)
+/** @brief Lets exceptions thrown inside coroutines leave io_context::run(), as those of other handlers do */
+struct rethrow_exception_handler {
+    void operator()(const std::exception_ptr &e) const {
+        if (e) std::rethrow_exception(e);
+    }
+};
+#endif
+
+/** @brief How clients deal with lost connections */
+struct reconnect_settings {
+    std::size_t max_attempts = 0; ///< Consecutive failed connection attempts before giving up. 0 disables reconnects
+    std::size_t initial_delay_ms = 100; ///< The upper limit of the first (random) delay
+    std::size_t max_delay_ms = 10000; ///< The delays grow exponentially up to this limit
+};
+
 /******************************************************************************************/
 ////////////////////////////////////////////////////////////////////////////////////////////
 /******************************************************************************************/
@@ -124,8 +159,9 @@ fail(beast::error_code ec, char const *what) {
  * the server-session side of the implementation remains serial. This is achieved by starting
  * a write only from the read-completion handler and vice versa.
  */
+template<typename transport_t>
 class async_websocket_client final
-    : public std::enable_shared_from_this<async_websocket_client>
+    : public std::enable_shared_from_this<async_websocket_client<transport_t>>
 {
 public:
     //--------------------------------------------------------------------------
@@ -140,17 +176,21 @@ public:
     async_websocket_client(
         std::string address
         , unsigned short port
+        , std::size_t echo_size
+        , const reconnect_settings &reconnect = reconnect_settings{}
+        , std::size_t client_id = 0
+        , std::size_t pipeline_depth = 1
+        , const std::string &cores = ""
+        , bool numa = false
     )
         : m_address{std::move(address)}
         , m_port{port}
-    {
-        // Set the auto_fragment option, so control frames are delivered timely
-        m_ws.auto_fragment(true);
-        m_ws.write_buffer_bytes(16384);
-
-        // Set the transfer mode according to the defines in CMakeLists.txt
-        set_transfer_mode(m_ws);
-    }
+        , m_echo_blob{make_echo_blob(echo_size)}
+        , m_reconnect{reconnect}
+        , m_client_id{client_id}
+        , m_pipeline_depth{std::max<std::size_t>(1, pipeline_depth)}
+        , m_placement{"client", cores, numa, cpu_topology()}
+    { /* nothing */ }
 
     //--------------------------------------------------------------------------
 
@@ -165,13 +205,24 @@ public:
      */
     void
     run() {
-        // Look up the domain name
-        m_resolver.async_resolve(
-                m_address,
-                std::to_string(m_port),
-                beast::bind_front_handler(
-                        &async_websocket_client::when_resolved,
-                        shared_from_this()));
+        // Pin our threads before measuring the speed. With a core list, the io thread (i.e. this one) and the
+        // processing thread get a core each, while with NUMA placement both share the node of our client id.
+        if (m_placement.enabled()) {
+            cpu_topology().report(std::cout);
+            std::size_t io_slot = m_placement.uses_core_list() ? 0 : m_client_id;
+            std::size_t processing_slot = m_placement.uses_core_list() ? 1 : m_client_id;
+            m_placement.pin(io_slot);
+            net::post(m_pool, [this, processing_slot]() { m_placement.pin(processing_slot); });
+            std::cout
+                    << "async_websocket_client::run(): io thread on cores " << core_list_string(m_placement.cores_for(io_slot))
+                    << ", processing thread on cores " << core_list_string(m_placement.cores_for(processing_slot)) << std::endl;
+        }
+
+        // The server takes our speed into account when distributing work
+        if (!echo_mode()) m_speed = measure_sort_speed();
+
+        // Look up the domain name (if any) and connect
+        async_start_connect();
 
         // This call will block until no more work remains in the ASIO work queue
         m_io_context.run();
@@ -181,8 +232,22 @@ public:
         m_pool.stop();
         m_pool.join();
 
-        // Close the websocket
-        m_ws.close(websocket::close_code::normal);
+        if (compression_codec::none != m_compressor.get_settings().codec) {
+            std::cout
+                    << "async_websocket_client::run(): " << m_n_raw_bytes << " bytes of messages were transferred as "
+                    << m_n_wire_bytes << " bytes (ratio " << double(m_n_wire_bytes) / double(m_n_raw_bytes) << ")" << std::endl;
+        }
+
+        if (m_n_reconnects > 0) {
+            std::cout << "async_websocket_client::run(): Reconnected " << m_n_reconnects << " times" << std::endl;
+        }
+
+        std::cout
+                << "async_websocket_client::run(): " << m_handler_memory.get_n_recycled() << " handler allocations used recycled memory, "
+                << m_handler_memory.get_n_heap() << " went to the heap" << std::endl;
+
+        // Close the connection. It may never have been established.
+        if (m_transport->is_open()) m_transport->close_on_error();
     }
 
 private:
@@ -190,74 +255,191 @@ private:
     // Communication and processing
 
     void
-    when_resolved(
-        beast::error_code ec,
-        const tcp::resolver::results_type &results
-    ) {
+    async_start_connect() {
+        // Each connection gets a fresh transport. Handlers of earlier connections recognize
+        // themselves by their generation and leave.
+        m_transport.emplace(net::make_strand(m_io_context));
+        m_in_buffer.consume(m_in_buffer.size());
+
+        // Answers of earlier connections are not sent any more
+        m_n_messages_received = 0;
+        m_n_answers_queued = 0;
+        m_answers.clear();
+        m_write_queue.clear();
+        m_writing = false;
+
+        m_transport->async_connect(
+                m_address,
+                m_port,
+                beast::bind_front_handler(
+                        &async_websocket_client::when_connected,
+                        this->shared_from_this(),
+                        m_generation));
+    }
+
+    //--------------------------------------------------------------------------
+    void
+    when_connected(std::size_t generation, beast::error_code ec) {
+        if (generation != m_generation) return;
         if (ec)
-            return fail(ec, "resolve");
+            return connection_failed(ec, "connect");
+
+        // The value of the Host HTTP header during the WebSocket handshake.
+        // See https://tools.ietf.org/html/rfc7230#section-5.4
+        auto host = m_address + ':' + std::to_string(m_port);
+
+        // Perform the handshake (if any)
+        m_transport->async_handshake(host,
+                                     beast::bind_front_handler(
+                                             &async_websocket_client::when_handshake_succeeded,
+                                             this->shared_from_this(),
+                                             m_generation));
+    }
+
+    //--------------------------------------------------------------------------
+    /**
+     * Connection problems end the client, unless reconnects were enabled. Then a new connection
+     * is attempted after a randomized, exponentially growing delay, so clients do not all hit the
+     * server at once when it comes back.
+     */
+    void
+    connection_failed(beast::error_code ec, char const *what) {
+        fail(ec, what);
+        if (m_stop || m_n_failed_attempts >= m_reconnect.max_attempts) return;
 
-        // Set the timeout for the operation
-        beast::get_lowest_layer(m_ws).expires_after(std::chrono::seconds(30));
+        // Handlers of the current connection may no longer act
+        m_generation++;
+        if (m_transport->is_open()) m_transport->close_on_error();
 
-        // Make the connection on the IP address we get from a lookup
-        beast::get_lowest_layer(m_ws).async_connect(
-                results,
+        auto delay = reconnect_delay(m_n_failed_attempts++);
+        std::cout
+                << "async_websocket_client: Reconnecting in " << delay.count() << " ms (attempt "
+                << m_n_failed_attempts << " of " << m_reconnect.max_attempts << ")" << std::endl;
+
+        m_reconnect_timer.expires_after(delay);
+        m_reconnect_timer.async_wait(
                 beast::bind_front_handler(
-                        &async_websocket_client::when_connected,
-                        shared_from_this()));
+                        &async_websocket_client::when_reconnect_due,
+                        this->shared_from_this()));
     }
 
     //--------------------------------------------------------------------------
     void
-    when_connected(beast::error_code ec, const tcp::resolver::results_type::endpoint_type &ep) {
+    when_reconnect_due(beast::error_code ec) {
+        if (ec) return;
+
+        // Work items of the old connection may still be processed. The pool handles its tasks
+        // in order, so we continue once it is idle, and the result has been set aside. Until
+        // then, the work guard keeps m_io_context.run() from returning.
+        net::post(m_pool, [self = this->shared_from_this(), guard = net::make_work_guard(m_io_context)]() {
+            net::post(self->m_io_context, [self]() { self->async_start_connect(); });
+        });
+    }
+
+    //--------------------------------------------------------------------------
+    // Full jitter: A random delay between 0 and the capped exponential backoff
+    std::chrono::milliseconds
+    reconnect_delay(std::size_t attempt) {
+        auto backoff = double(m_reconnect.initial_delay_ms) * std::pow(2., double(std::min<std::size_t>(attempt, 30)));
+        auto cap = std::min(backoff, double(m_reconnect.max_delay_ms));
+        std::uniform_real_distribution<double> dist(0., cap);
+        return std::chrono::milliseconds(static_cast<std::int64_t>(dist(m_rng_engine)));
+    }
+
+    //--------------------------------------------------------------------------
+    void
+    async_start_hello() {
+        // Introduce ourselves, and announce the result that did not make it through the last connection (if any)
+        client_hello hello;
+        hello.resume_token = m_resume_token;
+        hello.pending_result = !m_pending_result.empty();
+        hello.client_id = m_client_id;
+        hello.n_cores = std::thread::hardware_concurrency();
+        hello.speed = m_speed;
+        m_hello = hello_frame(hello);
+
+        m_transport->async_write(
+                net::buffer(m_hello),
+                beast::bind_front_handler(
+                        &async_websocket_client::when_hello_written,
+                        this->shared_from_this(),
+                        m_generation)
+        );
+    }
+
+    //--------------------------------------------------------------------------
+    void
+    when_hello_written(
+        std::size_t generation,
+        beast::error_code ec,
+        std::size_t /* nothing */
+    ) {
+        if (generation != m_generation) return;
         if (ec)
-            return fail(ec, "connect");
-
-        // Turn off the timeout on the tcp_stream, because
-        // the websocket stream has its own timeout system.
-        beast::get_lowest_layer(m_ws).expires_never();
-
-        // Set suggested timeout settings for the websocket
-        m_ws.set_option(
-                websocket::stream_base::timeout::suggested(
-                        beast::role_type::client));
-
-        // Set a decorator to change the User-Agent of the handshake
-        m_ws.set_option(websocket::stream_base::decorator(
-                [](websocket::request_type &req) {
-                    req.set(http::field::user_agent,
-                            std::string(BOOST_BEAST_VERSION_STRING) +
-                            " async_websocket_client ");
-                }));
-
-        // Update the m_address string. This will provide the value of the
-        // Host HTTP header during the WebSocket handshake.
-        // See https://tools.ietf.org/html/rfc7230#section-5.4
-        m_address += (':' + std::to_string(m_port));
+            return connection_failed(ec, "when_hello_written");
 
-        // Perform the websocket handshake
-        m_ws.async_handshake(m_address, "/",
-                             beast::bind_front_handler(
-                                     &async_websocket_client::when_handshake_succeeded,
-                                     shared_from_this()));
+        // Send the result once more (if any)
+        if (!m_pending_result.empty()) m_write_queue.push_back(m_pending_result);
+
+        // The server answers each of our messages with a work item. The HELLO frame asked for the first one.
+        for (std::size_t i = 1; i < m_pipeline_depth; i++) {
+            m_write_queue.push_back(control_frame(payload_command::GETDATA));
+        }
+
+        async_start_next_write();
     }
 
     //--------------------------------------------------------------------------
     void
-    async_start_write(const std::string &message) {
-        // Prepare the buffer for the next iteration
-        m_out_buffer.consume(m_out_buffer.size());
+    async_start_echo_write() {
+        // The blob is pre-built and never changes, so no copy into m_out_buffer is needed
+        m_transport->async_write(
+                net::buffer(m_echo_blob),
+                bind_handler_memory(m_handler_memory, beast::bind_front_handler(
+                        &async_websocket_client::when_written,
+                        this->shared_from_this(),
+                        m_generation))
+        );
+    }
+
+    //--------------------------------------------------------------------------
+    void
+    async_start_write(std::size_t generation, std::size_t sequence, std::string message) {
+        // Keep the message until the server has answered, so it can be sent again after a reconnect
+        if (m_reconnect.max_attempts > 0 && 1 == m_pipeline_depth) m_pending_result = message;
+        if (generation != m_generation) return;
+
+        // The session expects answers in the order it has sent its messages. Answers
+        // finishing early wait for those of earlier messages.
+        m_answers.emplace(sequence, std::move(message));
+        while (!m_answers.empty() && m_answers.begin()->first == m_n_answers_queued) {
+            m_write_queue.push_back(std::move(m_answers.begin()->second));
+            m_answers.erase(m_answers.begin());
+            m_n_answers_queued++;
+        }
+
+        async_start_next_write();
+    }
+
+    //--------------------------------------------------------------------------
+    void
+    async_start_next_write() {
+        // Only one write may be in progress at any time
+        if (m_writing || m_write_queue.empty()) return;
+        m_writing = true;
 
-        // Fill it with the message
-        beast::ostream(m_out_buffer) << message;
+        // Prepare the buffer and fill it with the message
+        m_out_buffer.consume(m_out_buffer.size());
+        beast::ostream(m_out_buffer) << m_write_queue.front();
+        compress_out_buffer();
 
         // Send the message
-        m_ws.async_write(
+        m_transport->async_write(
                 m_out_buffer.data(),
-                beast::bind_front_handler(
+                bind_handler_memory(m_handler_memory, beast::bind_front_handler(
                         &async_websocket_client::when_written,
-                        shared_from_this())
+                        this->shared_from_this(),
+                        m_generation))
         );
     }
 
@@ -265,58 +447,165 @@ private:
     void
     async_start_read() {
         // Do the next read
-        m_ws.async_read(
+        m_transport->async_read(
                 m_in_buffer,
-                beast::bind_front_handler(
+                bind_handler_memory(m_handler_memory, beast::bind_front_handler(
                         &async_websocket_client::when_read,
-                        shared_from_this())
+                        this->shared_from_this(),
+                        m_generation))
         );
     }
 
     //--------------------------------------------------------------------------
     void
-    when_handshake_succeeded(beast::error_code ec) {
+    when_handshake_succeeded(std::size_t generation, beast::error_code ec) {
+        if (generation != m_generation) return;
         if (ec)
-            return fail(ec, "handshake");
+            return connection_failed(ec, "handshake");
 
-        // Ask the server for data
-        async_start_write(
-                m_command_container.reset(
-                        payload_command::GETDATA
-                ).to_string()
-        );
+        // We are connected again
+        if (m_n_failed_attempts > 0) m_n_reconnects++;
+        m_n_failed_attempts = 0;
+
+        if (echo_mode()) {
+            // Start the exchange of opaque messages
+            async_start_echo_write();
+        } else {
+            // Introduce ourselves. The server answers with data.
+            async_start_hello();
+        }
 
         // Start the read cycle -- it will keep itself alive
         // Beast and ASIO allow reads and writes to happen concurrently to each other.
         // However, care must be taken that no two reads (or writes) may run in parallel.
+#if defined(ESTRAY_COROUTINES)
+        net::co_spawn(m_transport->get_executor(), read_loop(this->shared_from_this(), m_generation), rethrow_exception_handler{});
+#else
         async_start_read();
+#endif
+    }
+
+#if defined(ESTRAY_COROUTINES)
+    //--------------------------------------------------------------------------
+    // The read cycle of one connection as a coroutine. It keeps the client alive until the
+    // connection ends, instead of every single read handler doing so.
+    static net::awaitable<void> read_loop(std::shared_ptr<async_websocket_client> self, std::size_t generation) {
+        beast::error_code ec;
+        do {
+            co_await self->m_transport->async_read(self->m_in_buffer, net::redirect_error(net::use_awaitable, ec));
+        } while (self->on_read(generation, ec));
     }
+#endif
 
     //--------------------------------------------------------------------------
     void
     when_written(
+        std::size_t generation,
         beast::error_code ec,
         std::size_t bytes_transferred
     ) {
         boost::ignore_unused(bytes_transferred);
 
-        if (ec || m_stop)
+        if (generation != m_generation) return;
+        if (m_stop)
             return fail(ec, "when_written");
+        if (ec)
+            return connection_failed(ec, "when_written");
 
-        // We are done. Further writing is triggered by the task processing
+        // We are done. Further writing is triggered by the task processing, or by queued answers.
         m_out_buffer.consume(m_out_buffer.size());
+        if (m_writing) {
+            m_writing = false;
+            m_write_queue.pop_front();
+            async_start_next_write();
+        }
     }
 
     //--------------------------------------------------------------------------
     void
     when_read(
+        std::size_t generation,
         beast::error_code ec,
         std::size_t bytes_transferred)
     {
         boost::ignore_unused(bytes_transferred);
+        if (on_read(generation, ec)) async_start_read();
+    }
+
+    //--------------------------------------------------------------------------
+    // Acts on a message of the server. Returns true if another read is to be started.
+    bool
+    on_read(std::size_t generation, beast::error_code ec) {
+        if (generation != m_generation) return false;
+        if (m_stop) {
+            fail(ec, "when_read");
+            return false;
+        }
+        if (ec) {
+            connection_failed(ec, "when_read");
+            return false;
+        }
+
+        // The server answers only once it has received our last message
+        m_pending_result.clear();
+
+        // The server shuts down. No further read is started.
+        if (terminate_requested()) {
+            when_terminated();
+            return false;
+        }
+
+        if (echo_mode()) {
+            // Transport only: No de-serialization or processing takes place
+            m_in_buffer.consume(m_in_buffer.size());
+            async_start_echo_write();
+            count_package();
+            return true;
+        }
+
+        // Restore compressed messages. The answer will be compressed in the same way.
+        compression_settings used;
+        m_n_wire_bytes += m_in_buffer.size();
+        m_compress_reply = decompress_buffer(m_compressor, m_in_buffer, m_scratch_buffer, used);
+        if (m_compress_reply) m_compressor.set_settings(used);
+        m_n_raw_bytes += m_in_buffer.size();
+
+        // Our answers are sent in the order of the server's messages
+        auto sequence = m_n_messages_received++;
+
+        if (auto in_data = m_in_buffer.data(); flat_container_view(in_data.data(), in_data.size()).valid()) {
+            if (1 == m_pipeline_depth) {
+                // Flat containers are processed in place. The message moves to m_out_buffer (which is
+                // empty, as the last write has finished), from where it is later sent back unchanged.
+                // The old output buffer is reused for the next read.
+                m_out_buffer.consume(m_out_buffer.size());
+                swap(m_in_buffer, m_out_buffer);
+
+                boost::asio::post(
+                        m_pool
+                        , beast::bind_front_handler(
+                                &async_websocket_client::process_flat_request,
+                                this->shared_from_this(),
+                                m_generation)
+                );
+
+                return true;
+            }
+
+            // Several items are held at once, so each gets its own copy
+            boost::asio::post(
+                    m_pool
+                    , beast::bind_front_handler(
+                            &async_websocket_client::process_flat_message,
+                            this->shared_from_this(),
+                            m_generation,
+                            sequence,
+                            std::move(beast::buffers_to_string(in_data)))
+            );
 
-        if (ec || m_stop)
-            return fail(ec, "when_read");
+            m_in_buffer.consume(m_in_buffer.size());
+            return true;
+        }
 
         // Start asynchronous processing of the work item.
         // The next write-operation is initiated from process_request().
@@ -324,7 +613,9 @@ private:
                 m_pool
                 , beast::bind_front_handler(
                         &async_websocket_client::process_request,
-                        shared_from_this(),
+                        this->shared_from_this(),
+                        m_generation,
+                        sequence,
                         std::move(beast::buffers_to_string(m_in_buffer.data()))
                         )
         );
@@ -333,40 +624,57 @@ private:
 
         // Start a new read cycle so we may react to control frames
         // (in particular ping and close) and process responses
-        async_start_read();
+        return true;
     }
 
     //--------------------------------------------------------------------------
     void
-    process_request(std::string && in_data) {
-        // De-serialize the object
-        m_command_container.from_string(in_data);
+    process_request(std::size_t generation, std::size_t sequence, std::string && in_data) {
+        // De-serialize the object. Each message gets its own container, as several may be held at once.
+        auto container = std::make_shared<command_container>(payload_command::NONE, nullptr);
+        container->from_string(in_data);
 
         // Extract the command
-        auto inboundCommand = m_command_container.get_command();
+        auto inboundCommand = container->get_command();
 
         // Act on the command received
         switch (inboundCommand) {
             case payload_command::COMPUTE: {
+                if (container->is_latency_bound()) {
+                    // The item waits on the io_context instead of blocking the pool, so many of them may be held at once
+                    net::post(m_io_context, [self = this->shared_from_this(), generation, sequence, container]() {
+                        container->async_process(
+                                self->m_io_context.get_executor()
+                                , [self, generation, sequence, container]() {
+                                    container->set_command(payload_command::RESULT);
+                                    self->async_start_write(generation, sequence, container->to_string());
+                                    self->count_package();
+                                });
+                    });
+                    return;
+                }
+
                 // Process the work item
-                m_command_container.process();
+                container->process();
 
                 // Set the command for the way back to the server
-                m_command_container.set_command(payload_command::RESULT);
+                container->set_command(payload_command::RESULT);
             }
                 break;
 
             case payload_command::NODATA: // This must be a command payload
             case payload_command::ERROR: { // We simply ask for new work
-                // sleep for a short while (between 10 and 50 milliseconds, randomly),
-                // before we ask for new work, so the server is not bombarded with requests.
-                std::uniform_int_distribution<> dist(10, 50);
-                std::this_thread::sleep_for(std::chrono::milliseconds(dist(m_rng_engine)));
-
-                // Tell the server again we need work
-                m_command_container.reset(payload_command::GETDATA);
+                // Wait for a short while, before we ask for new work, so the server is not bombarded with requests
+                net::post(
+                        m_io_context
+                        , beast::bind_front_handler(
+                                &async_websocket_client::async_start_retry,
+                                this->shared_from_this(),
+                                generation,
+                                sequence)
+                );
             }
-                break;
+                return;
 
             case payload_command::TERMINATE: // We have been asked to stop
                 m_stop = true;
@@ -380,34 +688,208 @@ private:
             }
         }
 
-        // Serialize the object again and return the result
-        async_start_write(m_command_container.to_string());
+        // Serialize the object again and return the result. We are running inside
+        // of the thread pool, so the write needs to be initiated from within the
+        // strand of the websocket, where the read cycle lives.
+        net::post(
+                m_io_context
+                , beast::bind_front_handler(
+                        &async_websocket_client::async_start_write,
+                        this->shared_from_this(),
+                        generation,
+                        sequence,
+                        container->to_string())
+        );
+
+        count_package();
+    }
+
+    //--------------------------------------------------------------------------
+    void
+    async_start_retry(std::size_t generation, std::size_t sequence) {
+        // Between 10 and 50 milliseconds, randomly. A timer is used, so other items may be processed meanwhile.
+        std::uniform_int_distribution<> dist(10, 50);
+        auto timer = std::make_shared<net::steady_timer>(m_io_context, std::chrono::milliseconds(dist(m_rng_engine)));
+        timer->async_wait([self = this->shared_from_this(), timer, generation, sequence](beast::error_code) {
+            // Tell the server again we need work
+            self->async_start_write(generation, sequence, control_frame(payload_command::GETDATA));
+        });
+    }
+
+    //--------------------------------------------------------------------------
+    void
+    process_flat_message(std::size_t generation, std::size_t sequence, std::string && message) {
+        flat_container_view container(message.data(), message.size());
+
+        if (payload_command::COMPUTE != container.get_command()) {
+            throw std::runtime_error(
+                    "async_websocket_client::process_flat_message(): Got unexpected command " +
+                    boost::lexical_cast<std::string>(container.get_command())
+            );
+        }
+
+        // Process the work item inside the copy and mark it for the way back
+        container.sort();
+        container.set_command(payload_command::RESULT);
+
+        net::post(
+                m_io_context
+                , beast::bind_front_handler(
+                        &async_websocket_client::async_start_write,
+                        this->shared_from_this(),
+                        generation,
+                        sequence,
+                        std::move(message))
+        );
+
+        count_package();
+    }
+
+    //--------------------------------------------------------------------------
+    void
+    process_flat_request(std::size_t generation) {
+        // The message was moved to m_out_buffer in when_read()
+        auto data = m_out_buffer.data();
+        flat_container_view container(data.data(), data.size());
+
+        if (payload_command::COMPUTE != container.get_command()) {
+            throw std::runtime_error(
+                    "async_websocket_client::process_flat_request(): Got unexpected command " +
+                    boost::lexical_cast<std::string>(container.get_command())
+            );
+        }
+
+        // Process the work item inside the buffer and mark it for the way back
+        container.sort();
+        container.set_command(payload_command::RESULT);
+
+        // Initiate the write from within the I/O thread, as in process_request()
+        net::post(
+                m_io_context
+                , beast::bind_front_handler(
+                        &async_websocket_client::async_start_flat_write,
+                        this->shared_from_this(),
+                        generation)
+        );
+
+        count_package();
+    }
+
+    //--------------------------------------------------------------------------
+    void
+    async_start_flat_write(std::size_t generation) {
+        // Keep the result until the server has answered, so it can be sent again after a reconnect
+        if (m_reconnect.max_attempts > 0) m_pending_result = beast::buffers_to_string(m_out_buffer.data());
+        if (generation != m_generation) return;
+        m_n_answers_queued++;
+
+        // The processed message already sits in m_out_buffer
+        compress_out_buffer();
+
+        m_transport->async_write(
+                m_out_buffer.data(),
+                bind_handler_memory(m_handler_memory, beast::bind_front_handler(
+                        &async_websocket_client::when_written,
+                        this->shared_from_this(),
+                        m_generation))
+        );
+    }
+
+    //--------------------------------------------------------------------------
+    void
+    compress_out_buffer() {
+        m_n_raw_bytes += m_out_buffer.size();
+        if (m_compress_reply) compress_buffer(m_compressor, m_out_buffer, m_scratch_buffer);
+        m_n_wire_bytes += m_out_buffer.size();
+    }
 
+    //--------------------------------------------------------------------------
+    void
+    count_package() {
         // Update the package counter so we get an idea how many packages we have processed.
         if((++m_package_counter)%10==0) {
             std::cout << "Processed " << m_package_counter << " packages" << std::endl;
         }
     }
 
+    //--------------------------------------------------------------------------
+    // TERMINATE is sent uncompressed, even in transport-only mode
+    bool
+    terminate_requested() const {
+        auto data = m_in_buffer.data();
+        payload_command command = payload_command::NONE;
+        return parse_control_frame(static_cast<const char *>(data.data()), data.size(), command)
+               && payload_command::TERMINATE == command;
+    }
+
+    //--------------------------------------------------------------------------
+    void
+    when_terminated() {
+        std::cout << "async_websocket_client: The server asked us to terminate" << std::endl;
+
+        // Work still in progress (if any) may not be sent any more
+        m_stop = true;
+        m_generation++;
+        m_in_buffer.consume(m_in_buffer.size());
+
+        // We close the connection, so the server does not have to wait for us and
+        // the closed connection lingers (in TIME_WAIT) on our side instead of the server's
+        try {
+            if (m_transport->is_open()) m_transport->close();
+        } catch (const boost::system::system_error &e) {
+            std::cerr << "async_websocket_client: Could not close the connection: " << e.what() << std::endl;
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    bool
+    echo_mode() const {
+        return !m_echo_blob.empty();
+    }
+
     //--------------------------------------------------------------------------
     // Data
 
+    handler_memory m_handler_memory; ///< Recycled memory for reads and writes. Needs to outlive the io_context and transport
+
     net::io_context m_io_context; ///< The io_context is required for all I/O
 
-    tcp::resolver m_resolver{net::make_strand(m_io_context)};
-    websocket::stream<beast::tcp_stream> m_ws{net::make_strand(m_io_context)};
+    std::optional<transport_t> m_transport; ///< Re-created for each connection
+
+    message_buffer m_out_buffer;
+    message_buffer m_in_buffer;
+    message_buffer m_scratch_buffer; ///< Holds the other version of (de-)compressed messages
 
-    beast::flat_buffer m_out_buffer;
-    beast::flat_buffer m_in_buffer;
+    message_compressor m_compressor; ///< Takes over the settings of the last compressed message from the server
+    bool m_compress_reply = false; ///< Whether the last message from the server was compressed
+    std::size_t m_n_raw_bytes = 0; ///< The size of all messages before compression
+    std::size_t m_n_wire_bytes = 0; ///< The size of all messages as transferred
 
     std::string m_address;
     unsigned short m_port;
 
+    const std::string m_echo_blob; ///< Pre-built message used in transport-only mode. Empty in normal mode
+
     std::random_device m_nondet_rng; ///< Source of non-deterministic random numbers
     std::mt19937 m_rng_engine{m_nondet_rng()}; ///< The actual random number engine, seeded my m_nondet_rng
 
-    command_container m_command_container{payload_command::NONE,
-                                          nullptr}; ///< Holds the current command and payload (if any)
+    reconnect_settings m_reconnect;
+    net::steady_timer m_reconnect_timer{m_io_context};
+    std::size_t m_generation = 0; ///< Incremented whenever a connection is given up
+    std::size_t m_n_failed_attempts = 0; ///< Connection failures since the last successful handshake
+    std::size_t m_n_reconnects = 0;
+    std::uint64_t m_resume_token = (std::uint64_t(m_nondet_rng()) << 32U) | m_nondet_rng(); ///< Identifies us across reconnects
+    std::string m_hello; ///< The HELLO frame being sent
+    std::size_t m_client_id; ///< Sent to the server, so it may tell clients apart in its statistics
+    std::uint64_t m_speed = 0; ///< Values sorted per second, as measured at start-up
+    std::string m_pending_result; ///< The last message sent, until the server answers. Only kept if reconnects are enabled
+
+    std::size_t m_pipeline_depth; ///< The number of work items we hold at once
+    std::size_t m_n_messages_received = 0; ///< Messages received from the server on the current connection
+    std::size_t m_n_answers_queued = 0; ///< Answers queued for writing on the current connection
+    std::map<std::size_t, std::string> m_answers; ///< Answers waiting for those of earlier messages
+    std::deque<std::string> m_write_queue; ///< Answers to be written, in order
+    bool m_writing = false; ///< Whether the front of m_write_queue is being written
 
     /**
      * We use Boost.Asio's built-in thread pool to execute the processing. This way we do not have to rely
@@ -416,6 +898,7 @@ private:
      * implicit strand
      */
     boost::asio::thread_pool m_pool{1};
+    thread_placement m_placement; ///< Where the io and processing threads run
 
     std::atomic<std::uint32_t> m_package_counter{0};
     std::atomic<bool> m_stop{false};
@@ -423,6 +906,28 @@ private:
     //--------------------------------------------------------------------------
 };
 
+/******************************************************************************************/
+////////////////////////////////////////////////////////////////////////////////////////////
+/******************************************************************************************/
+/**
+ * Serializes a work item into a buffer, as it is sent to clients. The command_container takes
+ * over ownership of the payload. Containers may be written in the flat format, directly into
+ * the buffer.
+ */
+template<typename buffer_t>
+void serialize_work_item(command_container &container, payload_base *plb_ptr, bool flat_containers, buffer_t &buffer) {
+    container.reset(payload_command::COMPUTE, plb_ptr);
+
+    auto *container_ptr = flat_containers ? dynamic_cast<random_container_payload *>(plb_ptr) : nullptr;
+    if (container_ptr) {
+        auto size = flat_container_size(container_ptr->size());
+        write_flat_container(buffer.prepare(size).data(), payload_command::COMPUTE, *container_ptr);
+        buffer.commit(size);
+    } else {
+        boost::beast::ostream(buffer) << container.to_string();
+    }
+}
+
 /******************************************************************************************/
 ////////////////////////////////////////////////////////////////////////////////////////////
 /******************************************************************************************/
@@ -431,68 +936,148 @@ private:
  * all communication with the respective client. Note that no seperate in- and out-buffers
  * are needed, as read- and write-operations happen sequentially.
  */
+template<typename transport_t>
 class async_websocket_server_session final
-    : public std::enable_shared_from_this<async_websocket_server_session>
+    : public std::enable_shared_from_this<async_websocket_server_session<transport_t>>
 {
 public:
     //--------------------------------------------------------------------------
 
-    async_websocket_server_session(tcp::socket &&socket, // Take ownership of the socket
+    async_websocket_server_session(transport_t &&transport, // Take ownership of the connection
                                    std::function<bool(payload_base *&plb_ptr)> &&get_next_payload_item,
+                                   std::function<bool(net::const_buffer &entry)> &&get_next_spool_entry,
                                    std::function<bool()> &&check_server_stopped,
-                                   std::function<void(bool)> &&server_sign_on
+                                   std::function<void(bool)> &&server_sign_on,
+                                   std::function<void()> &&register_echo_package,
+                                   std::function<void(std::size_t, std::size_t)> &&register_traffic,
+                                   std::function<void(const char *, std::size_t)> &&store_result,
+                                   std::shared_ptr<const std::string> echo_blob_ptr,
+                                   bool flat_containers,
+                                   const compression_settings &compression,
+                                   const granularity_settings &granularity,
+                                   std::shared_ptr<inflight_tracker> tracker,
+                                   std::shared_ptr<client_registry> registry,
+                                   std::function<bool()> &&near_end_of_run,
+                                   std::shared_ptr<job_broker> broker,
+                                   std::function<bool(payload_base *plb_ptr)> &&submit_payload_item
     )
-        : m_ws(std::move(socket))
+        : m_transport(std::move(transport))
         , f_get_next_payload_item(std::move(get_next_payload_item))
+        , f_get_next_spool_entry(std::move(get_next_spool_entry))
         , f_check_server_stopped(std::move(check_server_stopped))
         , f_server_sign_on(std::move(server_sign_on))
-    {
-        // Set the auto_fragment option, so control frames are delivered timely
-        m_ws.auto_fragment(true);
-        m_ws.write_buffer_bytes(16384);
+        , f_register_echo_package(std::move(register_echo_package))
+        , f_register_traffic(std::move(register_traffic))
+        , f_store_result(std::move(store_result))
+        , m_echo_blob_ptr(std::move(echo_blob_ptr))
+        , m_flat_containers(flat_containers)
+        , m_compressor(compression)
+        , m_granularity(granularity)
+        , m_tracker(std::move(tracker))
+        , m_registry(std::move(registry))
+        , f_near_end_of_run(std::move(near_end_of_run))
+        , m_broker(std::move(broker))
+        , f_submit_payload_item(std::move(submit_payload_item))
+    { /* nothing */ }
+
+    //--------------------------------------------------------------------------
+
+    ~async_websocket_server_session() {
+        // Our work items need to be sent to another client
+        release_items();
 
-        // Set the transfer mode according to the defines in CMakeLists.txt
-        set_transfer_mode(m_ws);
+        // Make it known to the server that a session is leaving
+        if (m_signed_on) f_server_sign_on(false);
     }
 
     //--------------------------------------------------------------------------
     // Start the asynchronous operation
     void
     async_start_run() {
+#if defined(ESTRAY_COROUTINES)
+        // The whole exchange with the client runs as one coroutine on the transport's strand
+        net::co_spawn(m_transport.get_executor(), run_session(this->shared_from_this()), rethrow_exception_handler{});
+#else
         // We need to be executing within a strand to perform async operations
         // on the I/O objects in this session. Although not strictly necessary
         // for single-threaded contexts, this example code is written to be
         // thread-safe by default.
-        net::dispatch(m_ws.get_executor(),
+        net::dispatch(m_transport.get_executor(),
                       beast::bind_front_handler(
                               &async_websocket_server_session::when_run_started,
-                              shared_from_this()));
+                              this->shared_from_this()));
+#endif
+    }
+
+    //--------------------------------------------------------------------------
+    /**
+     * Asks the client to leave, without waiting for its next request. Its work item (if any)
+     * is given up. If force is set, the connection is closed right away instead.
+     */
+    void
+    async_terminate(bool force) {
+        net::post(m_transport.get_executor(),
+                  beast::bind_front_handler(
+                          &async_websocket_server_session::when_terminate_requested,
+                          this->shared_from_this(),
+                          force));
     }
 
 private:
+    //--------------------------------------------------------------------------
+    // What happens after a read or write has finished
+    enum class session_step { read, write, echo_write, idle };
+
+#if defined(ESTRAY_COROUTINES)
+    //--------------------------------------------------------------------------
+    // Reads requests and writes answers until the connection ends. The session is kept alive
+    // through self for the whole exchange, instead of through every single handler.
+    static net::awaitable<void> run_session(std::shared_ptr<async_websocket_server_session> self) {
+        beast::error_code ec;
+        co_await self->m_transport.async_accept(net::redirect_error(net::use_awaitable, ec));
+        if (ec) co_return self->do_close(ec, "run_session");
+
+        // Make it known to the server that a new session is alive
+        self->m_signed_on = true;
+        self->f_server_sign_on(true);
+
+        auto step = session_step::read;
+        while (session_step::idle != step) {
+            if (session_step::read == step) {
+                self->release_idle_memory();
+                self->m_reading = true;
+                co_await self->m_transport.async_read(self->m_in_buffer, net::redirect_error(net::use_awaitable, ec));
+                step = self->on_read(ec);
+            } else {
+                self->m_writing = true;
+                co_await self->m_transport.async_write(self->answer_buffer(session_step::echo_write == step), net::redirect_error(net::use_awaitable, ec));
+                step = self->on_written(ec);
+            }
+        }
+    }
+#endif
+
+    //--------------------------------------------------------------------------
+
+    void
+    continue_with(session_step step) {
+        switch (step) {
+            case session_step::read: return async_start_read();
+            case session_step::write: return async_start_write();
+            case session_step::echo_write: return async_start_echo_write();
+            case session_step::idle: return;
+        }
+    }
+
     //--------------------------------------------------------------------------
 
     void
     when_run_started() {
-        // Set suggested timeout settings for the websocket
-        m_ws.set_option(
-                websocket::stream_base::timeout::suggested(
-                        beast::role_type::server));
-
-        // Set a decorator to change the Server of the handshake
-        m_ws.set_option(websocket::stream_base::decorator(
-                [](websocket::response_type &res) {
-                    res.set(http::field::server,
-                            std::string(BOOST_BEAST_VERSION_STRING) +
-                            " async_websocket_server_session");
-                }));
-
-
-        // Accept the websocket handshake
-        m_ws.async_accept(
+        // Accept the handshake (if any)
+        m_transport.async_accept(
                 beast::bind_front_handler(
                         &async_websocket_server_session::when_connection_accepted,
-                        shared_from_this()));
+                        this->shared_from_this()));
     }
 
     //--------------------------------------------------------------------------
@@ -502,6 +1087,7 @@ private:
         if (ec) return do_close(ec, "when_connection_accepted");
 
         // Make it known to the server that a new session is alive
+        m_signed_on = true;
         f_server_sign_on(true);
 
         // Read a message into our buffer
@@ -512,12 +1098,32 @@ private:
 
     void
     async_start_read() {
+        // The client may take its time. Meanwhile, the memory of the last messages goes back to the pool.
+        release_idle_memory();
+        m_reading = true;
+
         // Read a message into our buffer
-        m_ws.async_read(
+        m_transport.async_read(
                 m_in_buffer,
-                beast::bind_front_handler(
+                bind_handler_memory(m_handler_memory, beast::bind_front_handler(
                         &async_websocket_server_session::when_read,
-                        shared_from_this()));
+                        this->shared_from_this())));
+    }
+
+    //--------------------------------------------------------------------------
+
+    void
+    release_idle_memory() {
+        // Small buffers are kept, so sessions exchanging small messages do not go to the pool each time
+        if (0 == m_in_buffer.size() && m_in_buffer.capacity() > KEPTBUFFERSIZE) m_in_buffer.shrink_to_fit();
+        if (!m_writing && 0 == m_out_buffer.size() && m_out_buffer.capacity() > KEPTBUFFERSIZE) m_out_buffer.shrink_to_fit();
+
+        m_scratch_buffer.consume(m_scratch_buffer.size());
+        if (m_scratch_buffer.capacity() > KEPTBUFFERSIZE) m_scratch_buffer.shrink_to_fit();
+
+        // The payload of the last work item or result, and the copy of a tracked item
+        m_command_container.reset(payload_command::NONE);
+        std::string().swap(m_tracked_item.message);
     }
 
     //--------------------------------------------------------------------------
@@ -527,29 +1133,106 @@ private:
             beast::error_code ec,
             std::size_t /* nothing */
     ) {
+        continue_with(on_read(ec));
+    }
+
+    //--------------------------------------------------------------------------
+
+    session_step
+    on_read(beast::error_code ec) {
+        m_reading = false;
+
         // This indicates that the session was closed
-        if (ec == websocket::error::closed) return;
+        if (ec == websocket::error::closed) return session_step::idle;
+
+        // After TERMINATE, we only wait for the client to close the connection
+        if (m_terminating) {
+            if (ec) return session_step::idle;
+            m_in_buffer.consume(m_in_buffer.size());
+            return session_step::read;
+        }
 
         // Act on errors
-        if (ec) return do_close(ec, "when_read");
+        if (ec) {
+            do_close(ec, "when_read");
+            return session_step::idle;
+        }
+
+        if (m_echo_blob_ptr) {
+            if (this->f_check_server_stopped()) {
+                prepare_terminate();
+                return session_step::write;
+            }
+
+            // Transport only: Answer with the pre-built blob without looking at the message
+            m_in_buffer.consume(m_in_buffer.size());
+            f_register_echo_package();
+            return session_step::echo_write;
+        }
+
+        // Restore compressed messages (if any)
+        compression_settings used;
+        auto n_wire_bytes = m_in_buffer.size();
+        decompress_buffer(m_compressor, m_in_buffer, m_scratch_buffer, used);
+        f_register_traffic(m_in_buffer.size(), n_wire_bytes);
 
         // process the request. This will read out
         // m_in_buffer and fill m_out_buffer with new data
         process_request();
 
+        // Some requests are not answered (the client sends another message first)
+        if (0 == m_out_buffer.size() && 0 == m_spool_entry.size()) return session_step::read;
+
+        if (m_terminating) {
+            f_register_traffic(m_out_buffer.size(), m_out_buffer.size());
+        } else if (m_spool_entry.size() > 0) {
+            // Spool entries were compressed (if at all) when the spool was created
+            const auto *data = static_cast<const char *>(m_spool_entry.data());
+            auto size = m_spool_entry.size();
+            f_register_traffic(
+                    message_compressor::is_compressed(data, size) ? message_compressor::raw_size(data, size) : size, size);
+        } else {
+            // Compress the answer, if it is large enough
+            auto n_raw_bytes = m_out_buffer.size();
+            compress_buffer(m_compressor, m_out_buffer, m_scratch_buffer);
+            f_register_traffic(n_raw_bytes, m_out_buffer.size());
+        }
+
         // Send the next buffer back
-        async_start_write();
+        return session_step::write;
+    }
+
+    //--------------------------------------------------------------------------
+    // Spool entries are sent straight from the mapped file
+    net::const_buffer
+    answer_buffer(bool echo) const {
+        if (echo) return net::buffer(*m_echo_blob_ptr);
+        if (m_spool_entry.size() > 0) return m_spool_entry;
+        return m_out_buffer.data();
     }
 
     //--------------------------------------------------------------------------
 
     void
     async_start_write() {
-        m_ws.async_write(
-                m_out_buffer.data(),
-                beast::bind_front_handler(
+        m_writing = true;
+        m_transport.async_write(
+                answer_buffer(false),
+                bind_handler_memory(m_handler_memory, beast::bind_front_handler(
                         &async_websocket_server_session::when_written,
-                        shared_from_this()));
+                        this->shared_from_this())));
+    }
+
+    //--------------------------------------------------------------------------
+
+    void
+    async_start_echo_write() {
+        m_writing = true;
+        m_transport.async_write(
+                answer_buffer(true),
+                bind_handler_memory(m_handler_memory, beast::bind_front_handler(
+                        &async_websocket_server_session::when_written,
+                        this->shared_from_this())));
     }
 
     //--------------------------------------------------------------------------
@@ -558,47 +1241,303 @@ private:
     when_written(
             beast::error_code ec,
             std::size_t /* nothing */) {
-        if (ec)
-            return fail(ec, "when_written");
+        continue_with(on_written(ec));
+    }
+
+    //--------------------------------------------------------------------------
+
+    session_step
+    on_written(beast::error_code ec) {
+        m_writing = false;
+        if (ec) {
+            // Errors are expected if the connection was closed after TERMINATE
+            if (!m_terminating) fail(ec, "when_written");
+            return session_step::idle;
+        }
 
         // Clear the buffer
         m_out_buffer.consume(m_out_buffer.size());
+        m_spool_entry = net::const_buffer();
+
+        if (m_terminating) {
+            // Wait for the client to close the connection. A read may still be pending,
+            // if the TERMINATE message did not answer a request.
+            return m_reading ? session_step::idle : session_step::read;
+        } else if (m_terminate_requested) {
+            // The server asked us to terminate while the last answer was being written
+            prepare_terminate();
+            return session_step::write;
+        }
 
-        if (this->f_check_server_stopped()) {
-            std::cout << "Server is stopped" << std::endl;
-            // Do not continue if a stop criterion was reached
+        // Start another read cycle
+        return session_step::read;
+    }
+
+    //--------------------------------------------------------------------------
+
+    void
+    when_terminate_requested(bool force) {
+        if (force) {
+            m_terminating = true;
+            if (m_transport.is_open()) m_transport.abort();
             return;
-        } else {
-            // Start another read cycle
-            async_start_read();
         }
+
+        if (m_terminating) return;
+        m_terminate_requested = true;
+
+        // The client is working on its item (if any), and we are waiting for its next request
+        if (m_reading && !m_writing) send_terminate();
+    }
+
+    //--------------------------------------------------------------------------
+
+    // Lets the client know that it may leave. The connection is then closed by the client.
+    void serialize_terminate() {
+        m_terminating = true;
+        release_items(); // Results arriving from now on are not accepted
+
+        if (m_granularity.enabled()) {
+            std::cout
+                    << "Session adapted to " << m_granularity.get_n_units() << " containers per work item ("
+                    << 1000. * m_granularity.get_time_per_unit() << " ms per container)" << std::endl;
+        }
+
+        // TERMINATE is never compressed, so clients recognize it without further ado
+        m_command_container.reset(payload_command::TERMINATE);
+        boost::beast::ostream(m_out_buffer) << m_command_container.to_string();
+    }
+
+    //--------------------------------------------------------------------------
+
+    void prepare_terminate() {
+        m_out_buffer.consume(m_out_buffer.size());
+        m_spool_entry = net::const_buffer();
+
+        serialize_terminate();
+        f_register_traffic(m_out_buffer.size(), m_out_buffer.size());
+    }
+
+    //--------------------------------------------------------------------------
+    // Used while the client works on its item, i.e. while a read is pending
+    void send_terminate() {
+        prepare_terminate();
+        async_start_write();
     }
 
     //--------------------------------------------------------------------------
 
-    std::string getAndSerializeWorkItem() {
-        // Obtain a container_payload object from the queue, serialize and return it
+    void getAndSerializeWorkItem() {
+        // Once the server has stopped, clients are sent home instead of receiving new work. Clients
+        // still working on items (--pipeline_depth) are not answered until their last result has
+        // arrived, or the drain timeout has passed, so these results are not lost.
+        if (this->f_check_server_stopped()) {
+            if (!m_items_in_flight.empty() && !m_terminate_requested) return;
+            return serialize_terminate();
+        }
+
+        // Pre-serialized work items are taken from the spool (if any) without touching m_out_buffer
+        if (f_get_next_spool_entry && f_get_next_spool_entry(m_spool_entry)) {
+            m_items_in_flight.push_back(item_in_flight{});
+            return;
+        }
+
+        // Slow clients would only delay the end of the run
+        if (withhold_work()) {
+            m_command_container.reset(payload_command::NODATA);
+            boost::beast::ostream(m_out_buffer) << m_command_container.to_string();
+            return;
+        }
+
+        // Items that need to be sent again take precedence over new work
+        if (m_tracker && m_tracker->redispatch(m_tracked_item, false)) return copy_tracked_item();
+
+        // Obtain a container_payload object from the queue and serialize it into m_out_buffer
         payload_base *plb_ptr = nullptr;
         if (this->f_get_next_payload_item(plb_ptr) && plb_ptr != nullptr) {
-            m_command_container.reset(payload_command::COMPUTE, plb_ptr);
+            item_in_flight item;
+            item.job_id = plb_ptr->get_job_id();
+            if (m_granularity.enabled()) item.n_units = combine_work_items(plb_ptr);
+            serialize_work_item(m_command_container, plb_ptr, m_flat_containers, m_out_buffer);
+
+            if (m_tracker) {
+                auto out_data = m_out_buffer.data();
+                item.id = m_tracker->dispatch(static_cast<const char *>(out_data.data()), out_data.size(), item.n_units, item.job_id);
+            }
+            m_items_in_flight.push_back(item);
+        } else if (m_tracker && m_tracker->redispatch(m_tracked_item, true)) {
+            // Out of new work: Help with an outstanding item (speculative execution)
+            copy_tracked_item();
         } else {
             // Let the remote side know whe don't have work
             m_command_container.reset(payload_command::NODATA);
+            boost::beast::ostream(m_out_buffer) << m_command_container.to_string();
+        }
+    }
+
+    //--------------------------------------------------------------------------
+
+    void copy_tracked_item() {
+        m_items_in_flight.push_back(item_in_flight{m_tracked_item.id, m_tracked_item.n_units, m_tracked_item.job_id});
+
+        auto size = m_tracked_item.message.size();
+        m_out_buffer.commit(net::buffer_copy(m_out_buffer.prepare(size), net::buffer(m_tracked_item.message)));
+    }
+
+    //--------------------------------------------------------------------------
+
+    // Clients answer in the order the work items were sent. Returns an empty item, if none is held.
+    item_in_flight next_item_in_flight() {
+        if (m_items_in_flight.empty()) return item_in_flight{};
+
+        auto item = m_items_in_flight.front();
+        m_items_in_flight.pop_front();
+        return item;
+    }
+
+    //--------------------------------------------------------------------------
+
+    // Takes the item a result belongs to. Returns false for results of items another client has
+    // already delivered and, with tracking, for results no held item is known for (e.g. one re-sent
+    // by a client whose old item could not be resumed).
+    bool accept_result(item_in_flight &item) {
+        bool held = !m_items_in_flight.empty();
+        item = next_item_in_flight();
+        if (!m_tracker) return true;
+        if (!held) {
+            m_tracker->discard_result();
+            return false;
+        }
+        if (0 == item.id) return true; // Spooled items are not tracked
+        return m_tracker->complete(item.id);
+    }
+
+    //--------------------------------------------------------------------------
+
+    void release_item(const item_in_flight &item) {
+        if (!m_tracker || 0 == item.id) return;
+        m_tracker->release(item.id, m_resume_token);
+    }
+
+    //--------------------------------------------------------------------------
+
+    void release_items() {
+        while (!m_items_in_flight.empty()) release_item(next_item_in_flight());
+    }
+
+    //--------------------------------------------------------------------------
+
+    bool withhold_work() const {
+        return m_registry && 0 != m_resume_token && f_near_end_of_run() && m_registry->is_slow(m_resume_token);
+    }
+
+    //--------------------------------------------------------------------------
+
+    // Verified results are stored, and handed to the submitter of the work item (if any)
+    void deliver_result(const item_in_flight &item, const char *data, std::size_t size) {
+        if (f_store_result) f_store_result(data, size);
+        if (m_broker && 0 != item.job_id) m_broker->complete(item.job_id, data, size);
+    }
+
+    //--------------------------------------------------------------------------
+
+    // Feeds the time the client spent on a work item into the scheduling
+    void register_processing_time(const item_in_flight &item, double processing_time) {
+        m_granularity.update(item.n_units, processing_time);
+        if (m_registry && 0 != m_resume_token) m_registry->record(m_resume_token, item.n_units, processing_time);
+    }
+
+    //--------------------------------------------------------------------------
+
+    // The first message of a client on each connection
+    void process_hello(const client_hello &hello) {
+        m_resume_token = hello.resume_token;
+        if (m_registry) m_registry->sign_on(hello);
+
+        // Fast clients start out with larger work items
+        m_granularity.seed(double(hello.speed));
+
+        if (hello.pending_result) {
+            // The client lost its connection before its last result got through and will send
+            // it next. It may still be accepted, if we can find out which item it belongs to.
+            release_items();
+            if (m_tracker && 0 != m_resume_token) {
+                if (auto item = m_tracker->resume(m_resume_token); 0 != item.id) m_items_in_flight.push_back(item);
+            }
+            return; // No answer, we wait for the result
         }
 
-        return m_command_container.to_string();
+        getAndSerializeWorkItem();
+    }
+
+    //--------------------------------------------------------------------------
+
+    // Appends further containers from the queue, so the work item takes the client about the target time.
+    // Returns the number of containers in the work item.
+    std::size_t combine_work_items(payload_base *plb_ptr) {
+        auto *container_ptr = dynamic_cast<random_container_payload *>(plb_ptr);
+        if (!container_ptr) {
+            throw std::runtime_error(
+                    "async_websocket_server_session::combine_work_items(): Only container payloads may be combined");
+        }
+
+        std::size_t n_units = 1;
+        payload_base *next_ptr = nullptr;
+        while (n_units < m_granularity.get_n_units()
+               && this->f_get_next_payload_item(next_ptr) && next_ptr != nullptr) {
+            std::unique_ptr<payload_base> next_owner(next_ptr);
+            auto *next_container_ptr = dynamic_cast<random_container_payload *>(next_ptr);
+            if (!next_container_ptr) {
+                throw std::runtime_error(
+                        "async_websocket_server_session::combine_work_items(): Only container payloads may be combined");
+            }
+
+            container_ptr->append(std::move(*next_container_ptr));
+            n_units++;
+        }
+
+        return n_units;
     }
 
     //--------------------------------------------------------------------------
 
     void process_request() {
-        // De-serialize the object
+        auto in_data = m_in_buffer.data();
+
+        // Results in the flat format are checked inside the buffer
+        if (flat_container_view container(in_data.data(), in_data.size()); container.valid()) {
+            if (payload_command::RESULT != container.get_command() || !container.is_sorted()) {
+                return reject_request("Returned flat container is unprocessed");
+            }
+            if (item_in_flight item; accept_result(item)) {
+                register_processing_time(item, container.get_processing_time());
+                deliver_result(item, static_cast<const char *>(in_data.data()), in_data.size());
+            }
+            m_in_buffer.consume(m_in_buffer.size());
+            return getAndSerializeWorkItem();
+        }
+
+        if (client_hello hello; parse_hello_frame(static_cast<const char *>(in_data.data()), in_data.size(), hello)) {
+            m_in_buffer.consume(m_in_buffer.size());
+            return process_hello(hello);
+        }
+
+        // Submitters talk to us in broker mode
+        broker_header request;
+        if (std::size_t body_offset = 0;
+            m_broker && parse_broker_header(static_cast<const char *>(in_data.data()), in_data.size(), request, body_offset)) {
+            process_broker_message(request, static_cast<const char *>(in_data.data()), in_data.size(), body_offset);
+            m_in_buffer.consume(m_in_buffer.size());
+            return;
+        }
+
+        // De-serialize the object. Control frames are recognized without copying the buffer.
         try {
-            m_command_container.from_string(beast::buffers_to_string(m_in_buffer.data()));
-            m_in_buffer.consume(m_in_buffer.size()); // Clear the buffer, so we may later fill it with data to be sent
+            if (!m_command_container.from_control_frame(static_cast<const char *>(in_data.data()), in_data.size())) {
+                m_command_container.from_string(beast::buffers_to_string(in_data));
+            }
         } catch (...) {
-            throw std::runtime_error(
-                    "async_websocket_server_session::process_request(): Caught exception while de-serializing");
+            return reject_request("Caught exception while de-serializing");
         }
 
         // Extract the command
@@ -608,27 +1547,129 @@ private:
         switch (inboundCommand) {
             case payload_command::GETDATA:
             case payload_command::ERROR: {
-                boost::beast::ostream(m_out_buffer) << getAndSerializeWorkItem();
+                // The client could not process its oldest item. GETDATA asks for more work, without giving any back.
+                if (payload_command::ERROR == inboundCommand) release_item(next_item_in_flight());
+                m_in_buffer.consume(m_in_buffer.size()); // Clear the buffer, so we may later fill it with data to be sent
+                getAndSerializeWorkItem();
             }
                 return;
 
             case payload_command::RESULT: {
                 // Check that work was indeed done
                 if (!m_command_container.is_processed()) {
-                    throw std::runtime_error(
-                            "async_websocket_server_session::process_request(): Returned payload is unprocessed");
+                    return reject_request("Returned payload is unprocessed");
+                }
+                if (item_in_flight item; accept_result(item)) {
+                    register_processing_time(item, m_command_container.get_payload()->get_processing_time());
+
+                    // Keep the result as received, before the buffer is cleared
+                    deliver_result(item, static_cast<const char *>(in_data.data()), in_data.size());
                 }
-                boost::beast::ostream(m_out_buffer) << getAndSerializeWorkItem();
+                m_in_buffer.consume(m_in_buffer.size());
+                getAndSerializeWorkItem();
             }
                 return;
 
             default: {
-                throw std::runtime_error(
-                        "async_websocket_server_session::process_request(): Got unknown or invalid command "
-                        + boost::lexical_cast<std::string>(inboundCommand)
-                );
+                return reject_request("Got unknown or invalid command " + boost::lexical_cast<std::string>(inboundCommand));
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /**
+     * Invalid messages end the run, unless we are a broker: External submitters may send
+     * anything, so their invalid messages are answered with REJECTED, and the broker keeps
+     * serving its other connections.
+     */
+    void reject_request(const std::string &reason) {
+        if (!m_broker) {
+            throw std::runtime_error("async_websocket_server_session::process_request(): " + reason);
+        }
+
+        m_in_buffer.consume(m_in_buffer.size());
+        m_out_buffer.consume(m_out_buffer.size());
+
+        broker_header answer;
+        answer.command = payload_command::REJECTED;
+        boost::beast::ostream(m_out_buffer) << broker_header_string(answer) << reason;
+    }
+
+    //--------------------------------------------------------------------------
+
+    // Answers SUBMIT with ACCEPTED and COLLECT with RESULTS
+    void process_broker_message(const broker_header &request, const char *data, std::size_t size, std::size_t body_offset) {
+        broker_header answer;
+        std::string body;
+
+        switch (request.command) {
+            case payload_command::SUBMIT: {
+                // Payloads are taken as long as the queue and the broker have room for them. The
+                // submitter sends the rest again later. Invalid input is rejected, the payloads
+                // before it remain accepted.
+                answer.command = payload_command::ACCEPTED;
+                auto job_id = m_broker->open_job(request.job_id);
+                if (0 == job_id) {
+                    answer.command = payload_command::REJECTED;
+                    answer.job_id = request.job_id;
+                    body = "Unknown job id " + std::to_string(request.job_id);
+                    break;
+                }
+
+                std::size_t n_accepted = 0;
+                const char *record = nullptr;
+                std::size_t record_size = 0;
+                std::size_t offset = body_offset;
+                while (!this->f_check_server_stopped() && m_broker->admits()) {
+                    std::unique_ptr<payload_base> payload_ptr;
+                    try {
+                        if (!next_broker_record(data, size, offset, record, record_size)) break;
+                        payload_ptr.reset(from_binary(std::string(record, record_size)));
+                    } catch (...) {
+                        body = "Record " + std::to_string(n_accepted) + " is truncated or could not be de-serialized";
+                        break;
+                    }
+                    if (!payload_ptr) {
+                        body = "Record " + std::to_string(n_accepted) + " does not hold a payload";
+                        break;
+                    }
+
+                    payload_ptr->set_job_id(job_id);
+                    m_broker->submitted(job_id, 1); // Before the payload may be processed
+                    if (!this->f_submit_payload_item(payload_ptr.get())) { // The queue is full
+                        m_broker->withdraw(job_id, 1);
+                        break;
+                    }
+                    payload_ptr.release();
+                    n_accepted++;
+                }
+
+                m_broker->describe(job_id, answer);
+                answer.n_records = n_accepted;
+                if (!body.empty()) answer.command = payload_command::REJECTED;
+            }
+                break;
+
+            case payload_command::COLLECT: {
+                answer.command = payload_command::RESULTS;
+                answer.job_id = request.job_id;
+                if (!m_broker->issued(request.job_id)) {
+                    answer.command = payload_command::REJECTED;
+                    body = "Unknown job id " + std::to_string(request.job_id);
+                    break;
+                }
+                m_broker->collect(request.job_id, request.n_records, body, answer);
+            }
+                break;
+
+            default: {
+                answer.command = payload_command::REJECTED;
+                answer.job_id = request.job_id;
+                body = "Invalid command " + boost::lexical_cast<std::string>(request.command);
             }
         }
+
+        boost::beast::ostream(m_out_buffer) << broker_header_string(answer) << body;
     }
 
     //--------------------------------------------------------------------------
@@ -641,29 +1682,59 @@ private:
                 << "Closing down session from " << where << std::endl
                 << "with error code " << ec.message() << std::endl;
 
-        if (m_ws.is_open()) {
+        if (m_transport.is_open()) {
             // Close the connection
-            m_ws.close(beast::websocket::close_code::protocol_error);
+            m_transport.close_on_error();
         }
-
-        // Make it known to the server that a session is leaving
-        f_server_sign_on(false);
     }
 
     //--------------------------------------------------------------------------
     // Data
 
-    websocket::stream<beast::tcp_stream> m_ws;
+    handler_memory m_handler_memory; ///< Recycled memory for reads and writes. Needs to outlive the transport
+
+    transport_t m_transport;
 
     std::function<bool(payload_base *&plb_ptr)> f_get_next_payload_item;
+    std::function<bool(net::const_buffer &entry)> f_get_next_spool_entry; ///< Empty if no spool is used
     std::function<bool()> f_check_server_stopped;
     std::function<void(bool)> f_server_sign_on;
+    std::function<void()> f_register_echo_package;
+    std::function<void(std::size_t, std::size_t)> f_register_traffic; ///< Message sizes before compression and on the wire
+    std::function<void(const char *, std::size_t)> f_store_result; ///< Empty if results are not stored
+
+    std::shared_ptr<const std::string> m_echo_blob_ptr; ///< Only set in transport-only mode
+    bool m_flat_containers; ///< Whether containers are sent in the in-place readable flat format
+
+    message_compressor m_compressor;
+    message_buffer m_scratch_buffer; ///< Holds the other version of (de-)compressed messages
+
+    net::const_buffer m_spool_entry; ///< The spool entry to be sent instead of m_out_buffer (if any)
+
+    granularity_controller m_granularity; ///< Sizes work items from the processing times reported by the client
+
+    std::shared_ptr<inflight_tracker> m_tracker; ///< Empty if in-flight items are not tracked
+    std::deque<item_in_flight> m_items_in_flight; ///< The work items held by the client, in the order they were sent
+    std::uint64_t m_resume_token = 0; ///< Identifies the client across reconnects. 0 if unknown
+
+    std::shared_ptr<client_registry> m_registry; ///< Statistics of all clients. Empty in transport-only mode
+    std::function<bool()> f_near_end_of_run;
+
+    std::shared_ptr<job_broker> m_broker; ///< Only set in broker mode
+    std::function<bool(payload_base *plb_ptr)> f_submit_payload_item; ///< Adds a submitted payload to the queue
+    tracked_item m_tracked_item; ///< Holds items to be sent again
 
     command_container m_command_container{payload_command::NONE,
                                           nullptr}; ///< Holds the current command and payload (if any)
 
-    beast::flat_buffer m_out_buffer;
-    beast::flat_buffer m_in_buffer;
+    message_buffer m_out_buffer;
+    message_buffer m_in_buffer;
+
+    bool m_signed_on = false; ///< Whether the server counts us as an active session
+    bool m_reading = false; ///< Whether a read is pending
+    bool m_writing = false; ///< Whether a write is pending
+    bool m_terminate_requested = false; ///< Set by the server, if the client should leave without waiting for its request
+    bool m_terminating = false; ///< Set once TERMINATE was sent. Then we only wait for the client to close the connection
 
     //--------------------------------------------------------------------------
 };
@@ -697,9 +1768,33 @@ public:
         , std::size_t n_max_packages_served
         , payload_type payload_type
         , std::size_t container_size
+        , random_generator generator
+        , std::uint64_t seed
+        , std::string record_path
+        , std::string replay_path
+        , std::string spool_path
         , double sleep_time
         , std::size_t full_queue_sleep_ms
         , std::size_t max_queue_size
+        , double warm_up_time
+        , double cool_down_time
+        , std::size_t sample_interval_ms
+        , double max_duration
+        , std::size_t echo_size
+        , transport_type transport
+        , std::string socket_path
+        , std::size_t shm_ring_size
+        , bool flat_containers
+        , const compression_settings &compression
+        , result_sink_settings results
+        , sort_settings sort
+        , granularity_settings granularity
+        , tracking_settings tracking
+        , double slow_client_fraction
+        , double drain_timeout
+        , const affinity_settings &affinity
+        , spill_settings spill
+        , const broker_settings &broker
     )
         : m_endpoint(net::ip::make_address(address), port)
         , m_n_listener_threads(n_context_threads > 0 ? n_context_threads : std::thread::hardware_concurrency())
@@ -707,92 +1802,181 @@ public:
         , m_payload_type(payload_type)
         , m_n_producer_threads(n_producer_threads > 0 ? n_producer_threads : std::thread::hardware_concurrency())
         , m_container_size(container_size)
+        , m_random_generator(generator)
+        , m_seed(seed)
+        , m_record_path(std::move(record_path))
+        , m_replay_path(std::move(replay_path))
+        , m_spool_path(std::move(spool_path))
         , m_sleep_time(sleep_time)
         , m_full_queue_sleep_ms(full_queue_sleep_ms)
         , m_max_queue_size(max_queue_size)
         , m_payload_queue{m_max_queue_size}
-    { /* nothing */ }
+        , m_warm_up_time(warm_up_time)
+        , m_cool_down_time(cool_down_time)
+        , m_sample_interval_ms(sample_interval_ms > 0 ? sample_interval_ms : 1)
+        , m_max_duration(max_duration)
+        , m_echo_blob_ptr(echo_size > 0 ? std::make_shared<const std::string>(make_echo_blob(echo_size)) : nullptr)
+        , m_transport_type(transport)
+        , m_socket_path(std::move(socket_path))
+        , m_shm_ring_size(shm_ring_size)
+        , m_flat_containers(flat_containers)
+        , m_compression(compression)
+        , m_results(std::move(results))
+        , m_sort(std::move(sort))
+        , m_granularity(granularity)
+        , m_tracking(tracking)
+        , m_slow_client_fraction(slow_client_fraction)
+        , m_drain_timeout(drain_timeout)
+        , m_io_placement("io", affinity.io_cores, affinity.numa, m_topology)
+        , m_producer_placement("producer", affinity.producer_cores, affinity.numa, m_topology)
+        , m_spill(std::move(spill))
+        , m_broker_settings(broker)
+    {
+        // Speeds announced by clients are converted to processing times of our containers
+        m_granularity.unit_size = m_container_size;
+    }
 
     void run() {
         beast::error_code ec;
 
-        // Reset the package counter
+        // Reset the package counter and throughput measurements
         m_n_packages_served = 0;
+        m_n_packages_sampled = 0;
+        m_throughput_samples.clear();
+        m_n_raw_bytes = 0;
+        m_n_wire_bytes = 0;
 
         // Indicate that the server is entering the run-state
         m_server_stopped = false;
 
-        // Open the acceptor
-        m_acceptor.open(m_endpoint.protocol(), ec);
-        if (ec) return fail(ec, "run() / m_acceptor.open()");
+        if (local_transport()) {
+            // Remove the socket file of an earlier run (if any)
+            boost::filesystem::remove(m_socket_path, ec);
 
-        // Bind to the server address
-        m_acceptor.bind(m_endpoint, ec);
-        if (ec) return fail(ec, "run() / m_acceptor.bind()");
+            // Open the acceptor
+            m_local_acceptor.open(local_stream(), ec);
+            if (ec) return fail(ec, "run() / m_local_acceptor.open()");
 
-        // Start listening for connections
-        m_acceptor.listen(net::socket_base::max_listen_connections, ec);
-        if (ec) return fail(ec, "run() / m_acceptor.listen()");
+            // Bind to the socket path
+            m_local_acceptor.bind(local_stream::endpoint(m_socket_path), ec);
+            if (ec) return fail(ec, "run() / m_local_acceptor.bind()");
 
-        // Start producers
-        m_producer_threads_vec.reserve(m_n_producer_threads);
-        switch (m_payload_type) {
-            //------------------------------------------------
-            case payload_type::container: {
-                for (std::size_t i = 0; i < m_n_producer_threads; i++) {
-                    m_producer_threads_vec.emplace_back(
-                            std::thread(
-                                    [this](std::size_t container_size, std::size_t full_queue_sleep_ms) {
-                                        this->container_payload_producer(container_size, full_queue_sleep_ms);
-                                    }, m_container_size, m_full_queue_sleep_ms
-                            )
-                    );
-                }
-            }
-                break;
+            // Start listening for connections
+            m_local_acceptor.listen(net::socket_base::max_listen_connections, ec);
+            if (ec) return fail(ec, "run() / m_local_acceptor.listen()");
+        } else {
+            // Open the acceptor
+            m_acceptor.open(m_endpoint.protocol(), ec);
+            if (ec) return fail(ec, "run() / m_acceptor.open()");
 
-                //------------------------------------------------
-            case payload_type::sleep: {
-                for (std::size_t i = 0; i < m_n_producer_threads; i++) {
-                    m_producer_threads_vec.emplace_back(
-                            std::thread(
-                                    [this](double sleep_time, std::size_t full_queue_sleep_ms) {
-                                        this->sleep_payload_producer(sleep_time, full_queue_sleep_ms);
-                                    }, m_sleep_time, m_full_queue_sleep_ms
-                            )
-                    );
-                }
+            // Connections of an earlier run may linger in TIME_WAIT. They must not keep us from binding.
+            m_acceptor.set_option(net::socket_base::reuse_address(true), ec);
+            if (ec) return fail(ec, "run() / m_acceptor.set_option()");
+
+            // Bind to the server address
+            m_acceptor.bind(m_endpoint, ec);
+            if (ec) return fail(ec, "run() / m_acceptor.bind()");
+
+            // Start listening for connections
+            m_acceptor.listen(net::socket_base::max_listen_connections, ec);
+            if (ec) return fail(ec, "run() / m_acceptor.listen()");
+        }
+
+        // Every payload produced in this run may be written to a workload file
+        m_workload_recorder.reset();
+        if (!m_record_path.empty() && !m_echo_blob_ptr && m_replay_path.empty() && m_spool_path.empty()) {
+            m_workload_recorder = std::make_unique<workload_recorder>(m_record_path);
+        }
+
+        // Verified results may be kept in a result file. When sorting, this holds the sorted runs.
+        m_result_sink.reset();
+        if (sort_mode()) {
+            m_n_sort_chunks = n_sort_chunks();
+            m_n_runs_returned = 0;
+            if (0 == m_n_sort_chunks) {
+                throw std::runtime_error("async_websocket_server::run(): There is nothing to sort");
             }
-                break;
+            m_result_sink = std::make_unique<result_sink>(run_sink_settings());
+        } else if (!m_results.path.empty() && !m_echo_blob_ptr) {
+            m_result_sink = std::make_unique<result_sink>(m_results);
+        }
 
-                //------------------------------------------------
-            case payload_type::command: { // This is a severe error
-                throw std::runtime_error(R"(async_websocket_server::run(): Got invalid payload_type "command")");
+        // Statistics of the clients, used for scheduling
+        m_registry.reset();
+        if (!m_echo_blob_ptr) m_registry = std::make_shared<client_registry>(m_slow_client_fraction);
+
+        // Work items sent to clients may be tracked until their results arrive
+        m_inflight.reset();
+        if (m_tracking.enabled && !m_echo_blob_ptr && m_spool_path.empty()) {
+            m_inflight = std::make_shared<inflight_tracker>(m_tracking);
+        }
+
+        // Payloads may overflow to disk while clients are slow. Only freshly produced payloads are spilled.
+        m_spill_queue.reset();
+        if (!m_spill.directory.empty() && !m_echo_blob_ptr && m_spool_path.empty() && m_replay_path.empty() && !sort_mode()) {
+            m_spill_queue = std::make_unique<spill_queue>(m_spill);
+        }
+
+        // Where our threads run. Always worth knowing on NUMA machines.
+        if (m_io_placement.enabled() || m_producer_placement.enabled() || m_topology.n_nodes() > 1) {
+            m_topology.report(std::cout);
+            m_io_placement.report(std::cout, m_n_listener_threads);
+            if (!m_echo_blob_ptr && m_spool_path.empty() && !m_broker_settings.enabled) {
+                m_producer_placement.report(std::cout, sort_mode() || !m_replay_path.empty() ? 1 : m_n_producer_threads);
             }
+        }
 
-                //------------------------------------------------
+        // In broker mode, submitters feed the queue through their sessions
+        m_broker.reset();
+        if (m_broker_settings.enabled) m_broker = std::make_shared<job_broker>(m_broker_settings);
+
+        // Start producers. They are not needed in transport-only mode, when serving from a spool or as a broker
+        if (m_echo_blob_ptr || m_broker) {
+            // Nothing
+        } else if (!m_spool_path.empty()) {
+            // Sessions take pre-serialized work items straight from the mapped file
+            m_spool_reader = std::make_unique<spool_reader>(m_spool_path);
+        } else {
+            start_producers();
         }
 
         //---------------------------------------------------------------------------
         // And ... action!
 
+        // Start the clock for the throughput measurements and the duration-based stop criterion
+        m_start_time = std::chrono::steady_clock::now();
+        m_stop_time = m_start_time;
+        m_last_sample_time = m_start_time;
+        async_start_sampling(m_start_time);
+
+        // SIGINT and SIGTERM stop the server in an orderly way
+        m_n_sessions_at_drain_timeout = 0;
+        m_n_sessions_aborted = 0;
+        m_signals.add(SIGINT, ec);
+        m_signals.add(SIGTERM, ec);
+        async_start_signal_wait();
+
         // Will return immediately
         async_start_accept();
 
-        // Allow to serve requests from multiple threads
+        // Allow to serve requests from multiple threads. This thread is io thread 0.
         m_context_thread_vec.reserve(m_n_listener_threads - 1);
         for (std::size_t t_cnt = 0; t_cnt < (m_n_listener_threads - 1); t_cnt++) {
             m_context_thread_vec.emplace_back(
                     std::thread(
-                            [this]() {
+                            [this](std::size_t io_thread_id) {
+                                this->m_io_placement.pin(io_thread_id);
                                 this->m_io_context.run();
-                            }
+                            }, t_cnt + 1
                     )
             );
         }
 
-        // Block until all work is done
+        // Block until all work is done. Threads started later on (e.g. for merging) must not inherit our core.
+        auto main_cores = current_thread_cores();
+        m_io_placement.pin(0);
         m_io_context.run();
+        if (m_io_placement.enabled()) pin_current_thread(main_cores);
 
         //---------------------------------------------------------------------------
         // Wait for the server to shut down
@@ -807,6 +1991,159 @@ public:
         // Wait for producer threads to finish
         for (auto &t: m_producer_threads_vec) { t.join(); }
         m_producer_threads_vec.clear();
+
+        // Payloads nobody asked for any more
+        std::size_t n_discarded = 0;
+        payload_base *plb_ptr = nullptr;
+        while (m_payload_queue.pop(plb_ptr)) {
+            delete plb_ptr;
+            n_discarded++;
+        }
+
+        m_signals.clear(ec);
+        {
+            std::lock_guard<std::mutex> lock(m_sessions_mutex);
+            m_sessions.clear();
+        }
+
+        std::cout
+                << "async_websocket_server: Shutdown took "
+                << std::chrono::duration<double>(std::chrono::steady_clock::now() - m_stop_time).count() << " s. "
+                << m_n_sessions_at_drain_timeout << " sessions were asked to terminate after the drain timeout, "
+                << m_n_sessions_aborted << " were closed without waiting for the client, "
+                << n_discarded << " queued payloads were discarded" << std::endl;
+
+        if (m_spill_queue) {
+            auto n_spilled = m_spill_queue->get_n_pushed();
+            auto n_restored = m_spill_queue->get_n_popped();
+            auto n_lost = m_spill_queue->get_n_read_failures();
+            std::cout
+                    << "async_websocket_server: " << n_spilled << " payloads were spilled to " << m_spill.directory
+                    << " (at most " << double(m_spill_queue->get_max_bytes_on_disk()) / (1024. * 1024.) << " MB at once), "
+                    << n_restored << " were read back, " << n_spilled - n_restored - n_lost << " were discarded" << std::endl;
+            if (auto n_failures = m_spill_queue->get_n_write_failures(); n_failures > 0) {
+                std::cout << "async_websocket_server: " << n_failures << " payloads could not be written to " << m_spill.directory
+                          << ", their producers waited instead" << std::endl;
+            }
+            if (n_lost > 0) {
+                std::cout << "async_websocket_server: " << n_lost << " payloads were lost, as their segments in " << m_spill.directory
+                          << " could not be read" << std::endl;
+            }
+            m_spill_queue.reset();
+        }
+
+        if (m_broker) {
+            m_broker->report(std::cout);
+            m_broker.reset();
+        }
+
+        if (m_workload_recorder) {
+            std::cout
+                    << "async_websocket_server: Recorded " << m_workload_recorder->get_n_records()
+                    << " payloads in " << m_record_path
+                    << (m_workload_recorder->failed() ? ". The recording is incomplete, as a write failed" : "") << std::endl;
+            m_workload_recorder.reset();
+        }
+
+        if (m_workload_reader) {
+            std::cout
+                    << "async_websocket_server: Replayed payloads from " << m_replay_path << " (started over "
+                    << m_workload_reader->get_n_passes() << " times)" << std::endl;
+            m_workload_reader.reset();
+        }
+
+        if (m_spool_reader) {
+            std::cout
+                    << "async_websocket_server: Served work items from " << m_spool_path << " (started over "
+                    << m_spool_reader->get_n_passes() << " times)" << std::endl;
+            m_spool_reader.reset();
+        }
+
+        // Write the remaining results. No session may store results any more.
+        if (m_result_sink) {
+            m_result_sink->close();
+            report_result_sink(sort_mode() ? run_sink_settings() : m_results);
+            m_result_sink.reset();
+        }
+
+        if (m_registry) {
+            m_registry->report(std::cout);
+            m_registry.reset();
+        }
+
+        auto pool = buffer_pool::get_statistics();
+        std::cout
+                << "buffer_pool: Handed out " << pool.n_allocations << " message buffers (" << pool.n_reused
+                << " from the cache), at most " << double(pool.max_bytes_in_use) / (1024. * 1024.) << " MB were in use, "
+                << double(pool.bytes_cached) / (1024. * 1024.) << " MB are cached (limit: "
+                << double(pool.max_bytes_cached) / (1024. * 1024.) << " MB)" << std::endl;
+
+        if (m_inflight) {
+            std::cout
+                    << "inflight_tracker: Sent " << m_inflight->get_n_requeued() << " items again after their session went away, "
+                    << m_inflight->get_n_timed_out() << " after a timeout, resumed " << m_inflight->get_n_resumed()
+                    << " items of reconnecting clients" << std::endl
+                    << "inflight_tracker: Sent " << m_inflight->get_n_speculative() << " speculative copies, ignored "
+                    << m_inflight->get_n_late_results() << " late results, " << m_inflight->get_n_in_flight()
+                    << " items were still outstanding" << std::endl;
+            m_inflight.reset();
+        }
+
+        // Turn the sorted runs into the sorted output
+        if (sort_mode()) merge_runs();
+
+        // The socket file is no longer needed
+        if (local_transport()) boost::filesystem::remove(m_socket_path, ec);
+
+        // Let the audience know about the steady-state throughput
+        report_throughput();
+    }
+
+    /**
+     * Pre-generates work items with the producers (or from a workload file) and writes them to
+     * a spool file, serialized (and possibly compressed) exactly as they would be sent to clients.
+     * Returns the number of entries written.
+     */
+    std::size_t create_spool(const std::string &path, std::size_t n_entries) {
+        spool_writer writer(path);
+
+        m_server_stopped = false;
+        start_producers();
+
+        command_container container{payload_command::NONE};
+        message_compressor compressor(m_compression);
+        beast::flat_buffer buffer;
+        beast::flat_buffer scratch;
+
+        payload_base *plb_ptr = nullptr;
+        while (writer.get_n_entries() < n_entries) {
+            if (!m_payload_queue.pop(plb_ptr)) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(m_full_queue_sleep_ms));
+                continue;
+            }
+
+            buffer.consume(buffer.size());
+            serialize_work_item(container, plb_ptr, m_flat_containers, buffer);
+            compress_buffer(compressor, buffer, scratch);
+
+            auto data = buffer.data();
+            writer.write(static_cast<const char *>(data.data()), data.size());
+        }
+
+        // Producers leave once the queue is full
+        m_server_stopped = true;
+        for (auto &t: m_producer_threads_vec) { t.join(); }
+        m_producer_threads_vec.clear();
+        m_workload_reader.reset();
+
+        while (m_payload_queue.pop(plb_ptr)) { delete plb_ptr; }
+
+        return writer.get_n_entries();
+    }
+
+    /** @brief Retrieves the number of packages served in the last call to run() */
+    std::size_t get_n_packages_served() const {
+        return m_n_packages_served.load();
     }
 
 private:
@@ -815,11 +2152,23 @@ private:
 
     void async_start_accept() {
         // The new connection gets its own strand
-        m_acceptor.async_accept(
-                net::make_strand(m_io_context),
-                beast::bind_front_handler(
-                        &async_websocket_server::when_accepted,
-                        shared_from_this()));
+        if (local_transport()) {
+            m_local_acceptor.async_accept(
+                    net::make_strand(m_io_context),
+                    beast::bind_front_handler(
+                            &async_websocket_server::when_local_accepted,
+                            shared_from_this()));
+        } else {
+            m_acceptor.async_accept(
+                    net::make_strand(m_io_context),
+                    beast::bind_front_handler(
+                            &async_websocket_server::when_accepted,
+                            shared_from_this()));
+        }
+    }
+
+    bool local_transport() const {
+        return transport_type::unix_socket == m_transport_type || transport_type::shm == m_transport_type;
     }
 
     void when_accepted(beast::error_code ec, tcp::socket socket) {
@@ -828,47 +2177,132 @@ private:
         if (ec) {
             fail(ec, "when accepted");
         } else {
-            // Create the async_websocket_server_session and async_start_run it. This call will return immediately.
-            std::make_shared<async_websocket_server_session>(
-                    std::move(socket),
-                    [this](payload_base *&plb_ptr) -> bool { return this->getNextPayloadItem(plb_ptr); },
-                    [this]() -> bool { return this->server_stopped(); },
-                    [this](bool sign_on) {
-                        if (sign_on) {
-                            this->m_n_active_sessions++;
+            // Create the session for the desired transport. This call will return immediately.
+            if (transport_type::tcp == m_transport_type) {
+                start_session(framed_transport<tcp>(std::move(socket)));
+            } else {
+                start_session(websocket_transport(std::move(socket)));
+            }
+        }
+
+        // Accept another connection
+        if (!this->m_server_stopped) async_start_accept();
+    }
+
+    void when_local_accepted(beast::error_code ec, local_stream::socket socket) {
+        if (m_server_stopped) return;
+
+        if (ec) {
+            fail(ec, "when local accepted");
+        } else {
+            // Create the session for the desired transport. This call will return immediately.
+            if (transport_type::shm == m_transport_type) {
+                try {
+                    start_session(shm_transport(std::move(socket), m_shm_ring_size));
+                } catch (const boost::interprocess::interprocess_exception &e) {
+                    std::cerr << "async_websocket_server: Could not create shared memory segment: " << e.what() << std::endl;
+                }
+            } else {
+                start_session(framed_transport<local_stream>(std::move(socket)));
+            }
+        }
+
+        // Accept another connection
+        if (!this->m_server_stopped) async_start_accept();
+    }
+
+    template<typename transport_t>
+    void start_session(transport_t &&transport) {
+        // Create the async_websocket_server_session and async_start_run it. This call will return immediately.
+        auto session = std::make_shared<async_websocket_server_session<transport_t>>(
+                std::move(transport),
+                [this](payload_base *&plb_ptr) -> bool { return this->getNextPayloadItem(plb_ptr); },
+                m_spool_reader
+                    ? std::function<bool(net::const_buffer &)>(
+                        [this](net::const_buffer &entry) -> bool { return this->getNextSpoolEntry(entry); })
+                    : std::function<bool(net::const_buffer &)>(),
+                [this]() -> bool { return this->server_stopped(); },
+                [this](bool sign_on) {
+                    if (sign_on) {
+                        this->m_n_active_sessions++;
+                    } else {
+                        if (0 == this->m_n_active_sessions) {
+                            throw std::runtime_error(
+                                    "In async_websocket_server::start_session(): Tried to decrement #sessions which is already 0");
                         } else {
-                            if (0 == this->m_n_active_sessions) {
-                                throw std::runtime_error(
-                                        "In async_websocket_server::when_accepted(): Tried to decrement #sessions which is already 0");
-                            } else {
-                                // This won't help, though, if m_n_active_sessions becomes 0 after the if-check
-                                this->m_n_active_sessions--;
+                            // This won't help, though, if m_n_active_sessions becomes 0 after the if-check
+                            if (0 == --this->m_n_active_sessions && this->m_server_stopped) {
+                                // The last session of a stopped server has ended
+                                net::post(this->m_stop_strand, [self = this->shared_from_this()]() { self->finish_shutdown(); });
                             }
                         }
-
-                        std::cout << this->m_n_active_sessions << " active sessions" << std::endl;
                     }
-            )->async_start_run();
+
+                    std::cout << this->m_n_active_sessions << " active sessions" << std::endl;
+                },
+                [this]() { this->count_served_package(); },
+                [this](std::size_t n_raw_bytes, std::size_t n_wire_bytes) {
+                    this->m_n_raw_bytes += n_raw_bytes;
+                    this->m_n_wire_bytes += n_wire_bytes;
+                },
+                m_result_sink
+                    ? std::function<void(const char *, std::size_t)>(
+                        [this](const char *data, std::size_t size) { this->store_result(data, size); })
+                    : std::function<void(const char *, std::size_t)>(),
+                m_echo_blob_ptr,
+                m_flat_containers,
+                m_compression,
+                m_granularity,
+                m_inflight,
+                m_registry,
+                [this]() -> bool { return this->near_end_of_run(); },
+                m_broker,
+                [this](payload_base *plb_ptr) -> bool { return this->m_payload_queue.push(plb_ptr); }
+        );
+
+        // The session may need to be terminated while waiting for its client
+        register_session(
+                session
+                , [weak_session = std::weak_ptr<async_websocket_server_session<transport_t>>(session)](bool force) {
+                    if (auto s = weak_session.lock()) s->async_terminate(force);
+                }
+        );
+
+        session->async_start_run();
+    }
+
+    void register_session(std::weak_ptr<void> session, std::function<void(bool)> &&terminate) {
+        std::lock_guard<std::mutex> lock(m_sessions_mutex);
+
+        // Forget sessions that have ended
+        m_sessions.erase(
+                std::remove_if(
+                        m_sessions.begin()
+                        , m_sessions.end()
+                        , [](const auto &entry) { return entry.first.expired(); })
+                , m_sessions.end());
+
+        m_sessions.emplace_back(std::move(session), std::move(terminate));
+    }
+
+    /** @brief Asks all sessions still alive to terminate. Returns their number */
+    std::size_t terminate_sessions(bool force) {
+        std::vector<std::function<void(bool)>> terminators;
+        {
+            std::lock_guard<std::mutex> lock(m_sessions_mutex);
+            for (const auto &entry: m_sessions) {
+                if (!entry.first.expired()) terminators.push_back(entry.second);
+            }
         }
 
-        // Accept another connection
-        if (!this->m_server_stopped) async_start_accept();
+        for (auto &terminate: terminators) terminate(force);
+        return terminators.size();
     }
 
     bool getNextPayloadItem(payload_base *&plb_ptr) {
         // Retrieve a new item, then update counters and the stop flag
         if (m_payload_queue.pop(plb_ptr)) {
-            if (m_n_packages_served++ < m_n_max_packages_served) {
-                if (m_n_packages_served % 10 == 0) {
-                    std::cout << "async_websocket_server served " << m_n_packages_served << " packages" << std::endl;
-                }
-            } else { // Leave
-                // Indicate to all parties that we want to stop
-                m_server_stopped = true;
-                // Stop accepting new connections
-                m_acceptor.close();
-            }
-
+            count_served_package();
             return true;
         }
 
@@ -876,14 +2310,120 @@ private:
         return false;
     }
 
+    bool getNextSpoolEntry(net::const_buffer &entry) {
+        // The spool never runs dry, as it starts over at its end
+        entry = m_spool_reader->next();
+        count_served_package();
+        return true;
+    }
+
+    void store_result(const char *data, std::size_t size) {
+        m_result_sink->store(data, size);
+
+        // A sorting run ends once all sorted runs are back
+        if (sort_mode() && ++m_n_runs_returned == m_n_sort_chunks) initiate_stop();
+    }
+
+    void count_served_package() {
+        // Update counters and the stop flag. Sorting runs are limited by their input instead.
+        auto n_served = ++m_n_packages_served;
+        if (sort_mode() || 0 == m_n_max_packages_served || n_served <= m_n_max_packages_served) {
+            if (n_served % 10 == 0) {
+                std::cout << "async_websocket_server served " << n_served << " packages" << std::endl;
+            }
+        } else { // Leave
+            initiate_stop();
+        }
+    }
+
+    void start_producers() {
+        m_producer_threads_vec.reserve(m_n_producer_threads);
+        if (sort_mode()) {
+            // A single thread splits the input into containers
+            m_producer_threads_vec.emplace_back(
+                    std::thread(
+                            [this](std::size_t full_queue_sleep_ms) {
+                                this->m_producer_placement.pin(0);
+                                this->sort_input_producer(full_queue_sleep_ms);
+                            }, m_full_queue_sleep_ms
+                    )
+            );
+        } else if (!m_replay_path.empty()) {
+            // A single thread feeds the queue from a workload file instead of the producers
+            m_workload_reader = std::make_unique<workload_reader>(m_replay_path);
+            m_producer_threads_vec.emplace_back(
+                    std::thread(
+                            [this](std::size_t full_queue_sleep_ms) {
+                                this->m_producer_placement.pin(0);
+                                this->replay_producer(full_queue_sleep_ms);
+                            }, m_full_queue_sleep_ms
+                    )
+            );
+        } else switch (m_payload_type) {
+            //------------------------------------------------
+            case payload_type::container: {
+                for (std::size_t i = 0; i < m_n_producer_threads; i++) {
+                    m_producer_threads_vec.emplace_back(
+                            std::thread(
+                                    [this](std::size_t container_size, std::size_t full_queue_sleep_ms, std::size_t producer_id) {
+                                        this->m_producer_placement.pin(producer_id);
+                                        this->container_payload_producer(container_size, full_queue_sleep_ms, producer_id);
+                                    }, m_container_size, m_full_queue_sleep_ms, i
+                            )
+                    );
+                }
+            }
+                break;
+
+                //------------------------------------------------
+            case payload_type::sleep: {
+                for (std::size_t i = 0; i < m_n_producer_threads; i++) {
+                    m_producer_threads_vec.emplace_back(
+                            std::thread(
+                                    [this](double sleep_time, std::size_t full_queue_sleep_ms, std::size_t producer_id) {
+                                        this->m_producer_placement.pin(producer_id);
+                                        this->sleep_payload_producer(sleep_time, full_queue_sleep_ms);
+                                    }, m_sleep_time, m_full_queue_sleep_ms, i
+                            )
+                    );
+                }
+            }
+                break;
+
+                //------------------------------------------------
+            case payload_type::command: { // This is a severe error
+                throw std::runtime_error(R"(async_websocket_server::start_producers(): Got invalid payload_type "command")");
+            }
+
+                //------------------------------------------------
+        }
+
+        // Spilled payloads are read back as soon as the queue has room for them
+        if (m_spill_queue) {
+            m_producer_threads_vec.emplace_back(
+                    std::thread(
+                            [this](std::size_t full_queue_sleep_ms) {
+                                this->spill_refill(full_queue_sleep_ms);
+                            }, m_full_queue_sleep_ms
+                    )
+            );
+        }
+    }
+
     void container_payload_producer(
         std::size_t containerSize
         , std::size_t full_queue_sleep_ms
+        , std::size_t producer_id
     ) {
-        std::random_device nondet_rng;
-        std::mt19937 mersenne(nondet_rng());
+        auto seed = producer_seed(producer_id);
+        std::seed_seq seed_sequence{std::uint32_t(seed), std::uint32_t(seed >> 32U)};
+        std::mt19937 mersenne(seed_sequence);
         std::normal_distribution<double> normalDist(0., 1.);
 
+        // Used instead of mersenne and normalDist for random_generator::xoshiro
+        bulk_normal_generator bulk_generator(seed);
+        std::vector<double> values(containerSize);
+
         bool produce_new_container = true;
         random_container_payload *sc_ptr = nullptr;
         while (true) {
@@ -892,11 +2432,26 @@ private:
             // Only create a new container if the old one was
             // successfully added to the queue
             if (produce_new_container) {
-                sc_ptr = new random_container_payload(containerSize, normalDist, mersenne);
+                if (random_generator::xoshiro == m_random_generator) {
+                    bulk_generator.fill(values.data(), values.size());
+                    sc_ptr = new random_container_payload(values);
+                } else {
+                    sc_ptr = new random_container_payload(containerSize, normalDist, mersenne);
+                }
+
+                if (m_workload_recorder && !m_workload_recorder->record(sc_ptr)) {
+                    delete sc_ptr;
+                    return stop_after_recording_failure();
+                }
             }
 
             if (!m_payload_queue.push(sc_ptr)) { // Container could not be added to the queue
                 if (this->m_server_stopped) break;
+                if (m_spill_queue && m_spill_queue->push(sc_ptr)) { // Keep it on disk and carry on
+                    delete sc_ptr;
+                    produce_new_container = true;
+                    continue;
+                }
                 produce_new_container = false;
                 std::this_thread::sleep_for(std::chrono::milliseconds(full_queue_sleep_ms));
             } else {
@@ -918,10 +2473,19 @@ private:
             // successfully added to the queue
             if (produce_new_container) {
                 sp_ptr = new sleep_payload(sleep_time);
+                if (m_workload_recorder && !m_workload_recorder->record(sp_ptr)) {
+                    delete sp_ptr;
+                    return stop_after_recording_failure();
+                }
             }
 
             if (!m_payload_queue.push(sp_ptr)) { // Container could not be added to the queue
                 if (this->m_server_stopped) break;
+                if (m_spill_queue && m_spill_queue->push(sp_ptr)) { // Keep it on disk and carry on
+                    delete sp_ptr;
+                    produce_new_container = true;
+                    continue;
+                }
                 produce_new_container = false;
                 std::this_thread::sleep_for(std::chrono::milliseconds(full_queue_sleep_ms));
             } else {
@@ -930,10 +2494,317 @@ private:
         }
     }
 
+    void replay_producer(std::size_t full_queue_sleep_ms) {
+        bool read_new_payload = true;
+        payload_base *plb_ptr = nullptr;
+        while (!this->m_server_stopped) {
+            // Only read a new payload if the old one was
+            // successfully added to the queue
+            if (read_new_payload) {
+                plb_ptr = m_workload_reader->next();
+            }
+
+            if (!m_payload_queue.push(plb_ptr)) { // Payload could not be added to the queue
+                read_new_payload = false;
+                std::this_thread::sleep_for(std::chrono::milliseconds(full_queue_sleep_ms));
+            } else {
+                read_new_payload = true;
+            }
+        }
+
+        // The last payload may not have made it into the queue
+        if (!read_new_payload) delete plb_ptr;
+    }
+
+    void spill_refill(std::size_t full_queue_sleep_ms) {
+        payload_base *plb_ptr = nullptr;
+        while (!this->m_server_stopped) {
+            // Only read a new payload if the old one was
+            // successfully added to the queue
+            if (!plb_ptr) plb_ptr = m_spill_queue->pop();
+
+            if (plb_ptr && m_payload_queue.push(plb_ptr)) {
+                plb_ptr = nullptr;
+            } else { // Nothing on disk, or no room in the queue
+                std::this_thread::sleep_for(std::chrono::milliseconds(full_queue_sleep_ms));
+            }
+        }
+
+        // The last payload may not have made it into the queue
+        delete plb_ptr;
+    }
+
+    void sort_input_producer(std::size_t full_queue_sleep_ms) {
+        // Random numbers are sorted if no input file was given
+        std::unique_ptr<sort_input_reader> reader;
+        if (!m_sort.input_path.empty()) reader = std::make_unique<sort_input_reader>(m_sort.input_path);
+        bulk_normal_generator bulk_generator(producer_seed(0));
+
+        std::vector<double> values(m_container_size);
+        for (std::size_t chunk = 0; chunk < m_n_sort_chunks && !this->m_server_stopped; chunk++) {
+            if (reader) {
+                reader->next(values, m_container_size);
+            } else {
+                bulk_generator.fill(values.data(), values.size());
+            }
+
+            auto *sc_ptr = new random_container_payload(values);
+            while (!m_payload_queue.push(sc_ptr)) { // Container could not be added to the queue
+                if (this->m_server_stopped) {
+                    delete sc_ptr;
+                    return;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(full_queue_sleep_ms));
+            }
+        }
+    }
+
+    /** @brief Whether only a few work items are left to be served (if this is known) */
+    bool near_end_of_run() const {
+        auto n_total = sort_mode() ? m_n_sort_chunks : m_n_max_packages_served;
+        if (0 == n_total) return false;
+
+        auto n_remaining_limit = 2 * std::max<std::size_t>(1, m_n_active_sessions.load());
+        return m_n_packages_served.load() + n_remaining_limit >= n_total;
+    }
+
+    bool sort_mode() const {
+        return !m_sort.output_path.empty();
+    }
+
+    /** @brief The number of containers the input of the sort is split into */
+    std::size_t n_sort_chunks() const {
+        if (m_sort.input_path.empty()) return m_n_max_packages_served;
+        return sort_input_reader(m_sort.input_path).get_n_chunks(m_container_size);
+    }
+
+    /** @brief The sorted runs go to the result file, if one was given */
+    result_sink_settings run_sink_settings() const {
+        auto settings = m_results;
+        if (settings.path.empty()) settings.path = m_sort.output_path + ".runs";
+
+        // Every run is needed for the output, so runs must never be dropped
+        settings.max_pending = std::numeric_limits<std::size_t>::max();
+        return settings;
+    }
+
+    void merge_runs() {
+        auto run_path = run_sink_settings().path;
+        if (m_n_runs_returned < m_n_sort_chunks) {
+            std::cout
+                    << "distributed_sort: Only " << m_n_runs_returned << " of " << m_n_sort_chunks
+                    << " sorted runs were returned. The output will be incomplete" << std::endl;
+        }
+
+        auto summary = merge_sorted_runs(run_path, m_sort.output_path, m_sort.n_merge_threads);
+        auto run_time = std::chrono::duration<double>(m_stop_time - m_start_time).count();
+        auto n_mb = double(summary.n_values * sizeof(double)) / (1024. * 1024.);
+
+        std::cout
+                << "distributed_sort: Merged " << summary.n_runs << " runs (" << summary.n_values << " values, "
+                << n_mb << " MB) from " << run_path << " into " << m_sort.output_path << std::endl
+                << "distributed_sort: Merge with " << summary.n_threads << " threads took " << summary.merge_time
+                << " s (" << (summary.merge_time > 0. ? n_mb / summary.merge_time : 0.) << " MB/s), "
+                << run_time + summary.merge_time << " s in total" << std::endl
+                << "distributed_sort: Output is " << (summary.sorted ? "sorted" : "NOT sorted") << std::endl;
+    }
+
+    /** @brief The seed of a producer's random number stream. Reproducible if a seed was given */
+    std::uint64_t producer_seed(std::size_t producer_id) const {
+        if (0 == m_seed) {
+            std::random_device nondet_rng;
+            return (std::uint64_t(nondet_rng()) << 32U) | nondet_rng();
+        }
+
+        return splitmix64(m_seed + producer_id);
+    }
+
     bool server_stopped() const {
         return this->m_server_stopped.load();
     }
 
+    // An incomplete recording could not be replayed faithfully, so the run ends. Called by
+    // producer threads, hence the stop is initiated on the io_context.
+    void stop_after_recording_failure() {
+        net::post(m_io_context, [self = shared_from_this()]() {
+            if (self->m_server_stopped) return;
+            std::cout << "async_websocket_server: Could not write to " << self->m_record_path << ", stopping" << std::endl;
+            self->initiate_stop();
+        });
+    }
+
+    void initiate_stop() {
+        // Only the first caller may stop the server
+        bool expected = false;
+        if (!m_server_stopped.compare_exchange_strong(expected, true)) return;
+
+        // Stop accepting new connections
+        m_acceptor.close();
+        m_local_acceptor.close();
+
+        // The sampling timer may only be touched from within its strand
+        net::post(
+                m_sample_timer.get_executor()
+                , [self = shared_from_this()]() {
+                    self->m_stop_time = std::chrono::steady_clock::now();
+                    self->m_sample_timer.cancel();
+                }
+        );
+
+        // Producers leave by themselves. Sessions send TERMINATE in answer to the next request of
+        // their client, so results still being computed are accepted. Clients that take longer than
+        // the drain timeout are asked to leave right away.
+        net::post(m_stop_strand, [self = shared_from_this()]() {
+            if (0 == self->m_n_active_sessions) return self->finish_shutdown();
+
+            self->m_drain_timer.expires_after(
+                    std::chrono::milliseconds(static_cast<std::int64_t>(1000. * self->m_drain_timeout)));
+            self->m_drain_timer.async_wait(
+                    beast::bind_front_handler(
+                            &async_websocket_server::when_drain_timeout,
+                            self));
+        });
+    }
+
+    void when_drain_timeout(beast::error_code ec) {
+        if (ec == net::error::operation_aborted) return;
+        if (ec) return fail(ec, "when_drain_timeout");
+
+        m_n_sessions_at_drain_timeout = terminate_sessions(false);
+        std::cout
+                << "async_websocket_server: Drain timeout reached, asked " << m_n_sessions_at_drain_timeout
+                << " sessions to terminate" << std::endl;
+
+        // Clients that do not react are not waited for
+        m_drain_timer.expires_after(std::chrono::milliseconds(CLOSEGRACEPERIODMS));
+        m_drain_timer.async_wait(
+                beast::bind_front_handler(
+                        &async_websocket_server::when_grace_period_over,
+                        shared_from_this()));
+    }
+
+    void when_grace_period_over(beast::error_code ec) {
+        if (ec == net::error::operation_aborted) return;
+        if (ec) return fail(ec, "when_grace_period_over");
+
+        m_n_sessions_aborted = terminate_sessions(true);
+    }
+
+    // Called from within m_stop_strand once no session is left
+    void finish_shutdown() {
+        m_drain_timer.cancel();
+        m_signals.cancel();
+    }
+
+    // --------------------------------------------------------------
+    // Signal handling
+
+    void async_start_signal_wait() {
+        m_signals.async_wait(
+                beast::bind_front_handler(
+                        &async_websocket_server::when_signalled,
+                        shared_from_this()));
+    }
+
+    void when_signalled(beast::error_code ec, int signal_number) {
+        if (ec == net::error::operation_aborted) return;
+        if (ec) return fail(ec, "when_signalled");
+
+        if (!m_server_stopped) {
+            // Stop in an orderly way. Another signal closes the remaining sessions right away.
+            std::cout << "async_websocket_server: Received signal " << signal_number << ", stopping" << std::endl;
+            initiate_stop();
+            async_start_signal_wait();
+        } else {
+            std::cout << "async_websocket_server: Received signal " << signal_number << ", closing all sessions" << std::endl;
+            m_drain_timer.cancel();
+            m_n_sessions_aborted = terminate_sessions(true);
+        }
+    }
+
+    // --------------------------------------------------------------
+    // Throughput measurements
+
+    // Deadlines are counted from the previous one rather than from the handler, so windows do not drift
+    void async_start_sampling(std::chrono::steady_clock::time_point last_deadline) {
+        m_sample_timer.expires_at(last_deadline + std::chrono::milliseconds(m_sample_interval_ms));
+        m_sample_timer.async_wait(
+                beast::bind_front_handler(
+                        &async_websocket_server::when_sampled,
+                        shared_from_this()));
+    }
+
+    void when_sampled(beast::error_code ec) {
+        // The timer was cancelled, as the server was stopped
+        if (ec == net::error::operation_aborted) return;
+        if (ec) return fail(ec, "when_sampled");
+
+        // Record the number of packages served in the last window. The handler may run late,
+        // so the window is as long as the time measured since the last sample.
+        auto now = std::chrono::steady_clock::now();
+        auto n_served = m_n_packages_served.load();
+        m_throughput_samples.push_back(throughput_sample{
+                std::chrono::duration<double>(m_last_sample_time - m_start_time).count()
+                , std::chrono::duration<double>(now - m_start_time).count()
+                , n_served - m_n_packages_sampled
+        });
+        m_n_packages_sampled = n_served;
+        m_last_sample_time = now;
+
+        // Check the duration-based stop criterion
+        if (m_max_duration > 0. && std::chrono::duration<double>(now - m_start_time).count() >= m_max_duration) {
+            std::cout << "async_websocket_server: Maximum duration of " << m_max_duration << " s reached" << std::endl;
+            m_stop_time = now;
+            initiate_stop();
+            return;
+        }
+
+        if (!m_server_stopped) async_start_sampling(m_sample_timer.expiry());
+    }
+
+    void report_throughput() const {
+        // Only complete windows outside of the warm-up and cool-down phases enter the statistics
+        auto run_time = std::chrono::duration<double>(m_stop_time - m_start_time).count();
+
+        std::vector<double> rates;
+        for (const auto &sample: m_throughput_samples) {
+            if (sample.window_start < m_warm_up_time) continue;
+            if (sample.window_end > run_time - m_cool_down_time) continue;
+            if (sample.window_end <= sample.window_start) continue;
+            rates.push_back(double(sample.n_served) / (sample.window_end - sample.window_start));
+        }
+
+        std::cout
+                << "async_websocket_server: " << m_n_packages_served << " packages served in " << run_time << " s" << std::endl
+                << "async_websocket_server: " << summarize_throughput(rates) << std::endl;
+
+        if (m_n_raw_bytes > 0) {
+            std::cout
+                    << "async_websocket_server: " << m_n_raw_bytes << " bytes of messages were transferred as "
+                    << m_n_wire_bytes << " bytes (ratio " << double(m_n_wire_bytes) / double(m_n_raw_bytes) << ")" << std::endl;
+        }
+    }
+
+    void report_result_sink(const result_sink_settings &settings) const {
+        auto write_time = m_result_sink->get_write_time();
+        auto elapsed = m_result_sink->get_elapsed_time();
+        auto n_mb = double(m_result_sink->get_n_bytes_written()) / (1024. * 1024.);
+
+        // A writer that is busy for most of the run is about to fall behind
+        std::cout
+                << "result_sink: Stored " << m_result_sink->get_n_stored() << " results (" << n_mb << " MB) in "
+                << settings.path << ", dropped " << m_result_sink->get_n_dropped() << std::endl
+                << "result_sink: " << m_result_sink->get_n_batches() << " batches, "
+                << (write_time > 0. ? n_mb / write_time : 0.) << " MB/s while writing, writer busy "
+                << (elapsed > 0. ? 100. * write_time / elapsed : 0.) << " % of the time" << std::endl
+                << "result_sink: At most " << double(m_result_sink->get_max_pending()) / (1024. * 1024.)
+                << " MB waited for the disk";
+        if (settings.max_pending < std::numeric_limits<std::size_t>::max()) {
+            std::cout << " (limit: " << double(settings.max_pending) / (1024. * 1024.) << " MB)";
+        }
+        std::cout << std::endl;
+    }
+
     // --------------------------------------------------------------
     // Data and Queues
 
@@ -941,6 +2812,7 @@ private:
     std::size_t m_n_listener_threads;
     net::io_context m_io_context{boost::numeric_cast<int>(m_n_listener_threads)};
     net::ip::tcp::acceptor m_acceptor{m_io_context};
+    local_stream::acceptor m_local_acceptor{m_io_context}; ///< Used instead of m_acceptor for local transports
     std::vector<std::thread> m_context_thread_vec;
     std::atomic<std::size_t> m_n_active_sessions{0};
     std::atomic<std::size_t> m_n_packages_served{0};
@@ -956,11 +2828,85 @@ private:
     std::vector<std::thread> m_producer_threads_vec; ///< Holds threads used to produce payload packages
 
     std::size_t m_container_size = 1000; ///< The size of container_payload objects
+    random_generator m_random_generator = random_generator::mt19937; ///< How the numbers of container_payload objects are produced
+    std::uint64_t m_seed = 0; ///< The basis of the producers' seeds. 0 means "non-deterministic"
+
+    std::string m_record_path; ///< Produced payloads are written to this file, if set
+    std::string m_replay_path; ///< The queue is fed from this file instead of the producers, if set
+    std::unique_ptr<workload_recorder> m_workload_recorder;
+    std::unique_ptr<workload_reader> m_workload_reader;
+
+    std::string m_spool_path; ///< Work items are served from this spool file instead of the queue, if set
+    std::unique_ptr<spool_reader> m_spool_reader;
     double m_sleep_time = 1.; ///< The sleep time of sleep_payload objects
 
     // Holds payloads to be passed to the sessions
     boost::lockfree::queue<payload_base *, boost::lockfree::fixed_sized<true>> m_payload_queue;
 
+    const double m_warm_up_time = 0.; ///< The time in seconds at the start of the run excluded from throughput statistics
+    const double m_cool_down_time = 0.; ///< The time in seconds at the end of the run excluded from throughput statistics
+    const std::size_t m_sample_interval_ms = 1000; ///< The length of each throughput window in milliseconds
+    const double m_max_duration = 0.; ///< The maximum duration of a run in seconds (0 means "no limit")
+
+    net::steady_timer m_sample_timer{net::make_strand(m_io_context)}; ///< Triggers throughput measurements
+
+    std::mutex m_sessions_mutex;
+    std::vector<std::pair<std::weak_ptr<void>, std::function<void(bool)>>> m_sessions; ///< Sessions that may still be alive
+    std::chrono::steady_clock::time_point m_start_time; ///< The start of the serving phase
+    std::chrono::steady_clock::time_point m_stop_time; ///< The time at which the stop criterion was reached
+    std::size_t m_n_packages_sampled = 0; ///< The number of packages served at the last measurement
+    std::chrono::steady_clock::time_point m_last_sample_time; ///< When the last measurement was taken
+
+    struct throughput_sample {
+        double window_start; ///< In seconds since m_start_time
+        double window_end; ///< In seconds since m_start_time
+        std::size_t n_served; ///< The packages served in this window
+    };
+    std::vector<throughput_sample> m_throughput_samples; ///< One entry per measurement window
+
+    std::shared_ptr<const std::string> m_echo_blob_ptr; ///< The message exchanged in transport-only mode (if any)
+
+    transport_type m_transport_type = transport_type::websocket; ///< The transport used by the sessions
+    std::string m_socket_path; ///< The path of the unix domain socket used by local transports
+    std::size_t m_shm_ring_size; ///< The size in bytes of each ring buffer of the shared-memory transport
+    bool m_flat_containers; ///< Whether container payloads are sent in the in-place readable flat format
+
+    compression_settings m_compression; ///< The compression of messages sent to clients
+    std::atomic<std::uint64_t> m_n_raw_bytes{0}; ///< The size of all messages before compression (both directions)
+    std::atomic<std::uint64_t> m_n_wire_bytes{0}; ///< The size of all messages as transferred (both directions)
+
+    result_sink_settings m_results; ///< Where and how verified results are stored
+    std::unique_ptr<result_sink> m_result_sink; ///< Only set while results are stored
+
+    sort_settings m_sort; ///< The server acts as a distributed sort if an output path was given
+    std::size_t m_n_sort_chunks = 0; ///< The number of containers the input of the sort was split into
+    std::atomic<std::size_t> m_n_runs_returned{0};
+
+    granularity_settings m_granularity; ///< The adaptive sizing of work items (if enabled)
+
+    tracking_settings m_tracking; ///< How work items are tracked until their results arrive
+    std::shared_ptr<inflight_tracker> m_inflight; ///< Shared with the sessions, so it outlives them
+
+    double m_slow_client_fraction; ///< Clients slower than this fraction of the median get no work at the end of a run
+    std::shared_ptr<client_registry> m_registry;
+
+    const double m_drain_timeout = 10.; ///< The time in seconds the server waits for outstanding results after the stop
+    net::strand<net::io_context::executor_type> m_stop_strand{net::make_strand(m_io_context)}; ///< Serializes the shutdown
+    net::steady_timer m_drain_timer{m_stop_strand};
+    net::signal_set m_signals{m_stop_strand};
+    std::size_t m_n_sessions_at_drain_timeout = 0; ///< Sessions asked to terminate before their client's next request
+    std::size_t m_n_sessions_aborted = 0; ///< Sessions closed without waiting for their client
+
+    const cpu_topology m_topology; ///< The NUMA nodes and cores available to us
+    const thread_placement m_io_placement; ///< Where the io threads run
+    const thread_placement m_producer_placement; ///< Where the producer threads run
+
+    const spill_settings m_spill;
+    std::unique_ptr<spill_queue> m_spill_queue; ///< Takes produced payloads the memory queue has no room for, if set
+
+    const broker_settings m_broker_settings;
+    std::shared_ptr<job_broker> m_broker; ///< Keeps the jobs of submitters. Only set in broker mode
+
     // --------------------------------------------------------------
 };
 
@@ -0,0 +1,216 @@
+/**
+ * @file broker.hpp
+ */
+
+/*
+ * The following license applies to the code in this file:
+ *
+ * **************************************************************************
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * **************************************************************************
+ *
+ * Author: Dr. Rüdiger Berlich of Gemfony scientific UG (haftungsbeschraenkt)
+ * See http://www.gemfony.eu for further information.
+ *
+ * This code is based on the Beast Websocket library by Vinnie Falco.
+ */
+
+#pragma once
+
+/******************************************************************************************/
+/*
+ * Broker mode: Instead of our own producers, external submitters feed the payload queue.
+ * A submitter sends batches of serialized payloads for a job and later collects the results
+ * of the job, as they were returned by the clients. The broker keeps the results until they
+ * have been collected and forgets a job once all of its results have been handed out. The
+ * memory held for uncollected results is bounded: Once the limit is reached, no further
+ * payloads are accepted until submitters have collected some results.
+ */
+
+// Standard headers go here
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+
+// Boost headers go here
+// Nothing
+
+// Our own headers go here
+#include "misc.hpp"
+
+/******************************************************************************************/
+
+/** @brief The settings of the broker mode */
+struct broker_settings {
+    bool enabled = false; ///< Whether payloads come from submitters instead of our own producers
+    std::size_t max_pending_bytes = std::size_t(1024) * 1024 * 1024; ///< The largest amount of results waiting to be collected
+    std::size_t max_results_per_message = 1024; ///< The most results handed out with a single RESULTS message
+};
+
+/******************************************************************************************/
+////////////////////////////////////////////////////////////////////////////////////////////
+/******************************************************************************************/
+/**
+ * Keeps the jobs of submitters and their results. Thread-safe.
+ */
+class job_broker {
+public:
+    explicit job_broker(const broker_settings &settings)
+        : m_settings(settings) { /* nothing */ }
+
+    job_broker(const job_broker &) = delete;
+    job_broker &operator=(const job_broker &) = delete;
+
+    /**
+     * Returns the id of the job a batch of payloads is submitted to. A new job is created if
+     * job_id is 0. Jobs whose results have all been collected may be resumed by their id.
+     */
+    std::uint64_t open_job(std::uint64_t job_id) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (0 == job_id) job_id = ++m_last_job_id;
+        if (job_id > m_last_job_id) return 0; // Never handed out
+        m_jobs[job_id];
+        return job_id;
+    }
+
+    /** @brief Whether a job id was handed out by us. Its job may have been finished since */
+    bool issued(std::uint64_t job_id) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return 0 != job_id && job_id <= m_last_job_id;
+    }
+
+    /** @brief Whether new payloads may be accepted, i.e. there is room for their results */
+    bool admits() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_pending_bytes < m_settings.max_pending_bytes;
+    }
+
+    /** @brief Registers payloads that were added to the queue on behalf of a job */
+    void submitted(std::uint64_t job_id, std::size_t n_payloads) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs[job_id].n_submitted += n_payloads;
+        m_n_submitted += n_payloads;
+    }
+
+    /** @brief Takes back payloads registered with submitted(), which could not be added to the queue after all */
+    void withdraw(std::uint64_t job_id, std::size_t n_payloads) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs[job_id].n_submitted -= n_payloads;
+        m_n_submitted -= n_payloads;
+    }
+
+    /** @brief Keeps the result of a payload of a job until it is collected */
+    void complete(std::uint64_t job_id, const char *data, std::size_t size) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_jobs.find(job_id);
+        if (it == m_jobs.end()) return; // Results of jobs we do not know are dropped
+
+        it->second.results.emplace_back(data, size);
+        it->second.n_completed++;
+        m_pending_bytes += size;
+        m_n_completed++;
+    }
+
+    /**
+     * Appends up to max_results results of a job to body (as records of a RESULTS message)
+     * and fills in the state of the job. The job is forgotten once all of its results have
+     * been collected. Returns false if the job is unknown.
+     */
+    bool collect(std::uint64_t job_id, std::size_t max_results, std::string &body, broker_header &header) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_jobs.find(job_id);
+        if (it == m_jobs.end()) return false;
+
+        auto &job = it->second;
+        if (0 == max_results || max_results > m_settings.max_results_per_message) max_results = m_settings.max_results_per_message;
+
+        std::size_t n_records = 0;
+        while (n_records < max_results && !job.results.empty()) {
+            const auto &result = job.results.front();
+            append_broker_record(body, result.data(), result.size());
+            m_pending_bytes -= result.size();
+            job.results.pop_front();
+            n_records++;
+        }
+        job.n_collected += n_records;
+        m_n_collected += n_records;
+
+        header.job_id = job_id;
+        header.n_records = n_records;
+        header.n_submitted = job.n_submitted;
+        header.n_completed = job.n_completed;
+        header.n_collected = job.n_collected;
+
+        if (job.n_collected == job.n_submitted) m_jobs.erase(it);
+        return true;
+    }
+
+    /** @brief Fills in the state of a job, as sent with ACCEPTED messages */
+    void describe(std::uint64_t job_id, broker_header &header) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        header.job_id = job_id;
+        auto it = m_jobs.find(job_id);
+        if (it == m_jobs.end()) return;
+
+        header.n_submitted = it->second.n_submitted;
+        header.n_completed = it->second.n_completed;
+        header.n_collected = it->second.n_collected;
+    }
+
+    void report(std::ostream &o) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        o
+                << "job_broker: " << m_last_job_id << " jobs, " << m_n_submitted << " payloads submitted, "
+                << m_n_completed << " results arrived, " << m_n_collected << " were collected. "
+                << m_jobs.size() << " jobs are unfinished" << std::endl;
+    }
+
+private:
+    struct job {
+        std::size_t n_submitted = 0;
+        std::size_t n_completed = 0;
+        std::size_t n_collected = 0;
+        std::deque<std::string> results; ///< Results waiting to be collected, in the order they arrived
+    };
+
+    const broker_settings m_settings;
+
+    mutable std::mutex m_mutex;
+    std::map<std::uint64_t, job> m_jobs;
+    std::uint64_t m_last_job_id = 0;
+    std::size_t m_pending_bytes = 0; ///< The size of all results waiting to be collected
+
+    std::size_t m_n_submitted = 0;
+    std::size_t m_n_completed = 0;
+    std::size_t m_n_collected = 0;
+};
+
+/******************************************************************************************/
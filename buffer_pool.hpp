@@ -0,0 +1,249 @@
+/**
+ * @file buffer_pool.hpp
+ */
+
+/*
+ * The following license applies to the code in this file:
+ *
+ * **************************************************************************
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * **************************************************************************
+ *
+ * Author: Dr. Rüdiger Berlich of Gemfony scientific UG (haftungsbeschraenkt)
+ * See http://www.gemfony.eu for further information.
+ *
+ * This code is based on the Beast Websocket library by Vinnie Falco.
+ */
+
+#pragma once
+
+/******************************************************************************************/
+/*
+ * A process-wide pool of message buffers. Memory is handed out in size classes (powers of two,
+ * starting at 4 KiB), and returned blocks are kept in a free list per class, up to a limit on
+ * the total amount of cached memory. Each size class has a lock of its own, and the usage
+ * figures are atomic. Sessions give large buffers back between messages, so the memory held
+ * for messages grows with the number of messages in flight, not with the number of (mostly
+ * idle) sessions.
+ */
+
+// Standard headers go here
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <vector>
+
+// Boost headers go here
+// Nothing
+
+// Our own headers go here
+// Nothing
+
+/******************************************************************************************/
+
+/** @brief Usage figures of the buffer pool */
+struct buffer_pool_statistics {
+    std::size_t n_allocations = 0; ///< The number of blocks handed out
+    std::size_t n_reused = 0; ///< The number of blocks taken from the cache instead of the heap
+    std::size_t bytes_in_use = 0; ///< The size of the blocks currently handed out
+    std::size_t max_bytes_in_use = 0;
+    std::size_t bytes_cached = 0; ///< The size of the blocks waiting in the free lists
+    std::size_t max_bytes_cached = 0; ///< The limit of bytes_cached
+};
+
+/******************************************************************************************/
+////////////////////////////////////////////////////////////////////////////////////////////
+/******************************************************************************************/
+
+class buffer_pool {
+public:
+    static constexpr std::size_t MINCLASSBITS = 12; ///< The smallest class holds 4 KiB
+    static constexpr std::size_t NCLASSES = 19; ///< The largest class holds 1 GiB. Larger requests go to the heap
+
+    //--------------------------------------------------------------------------
+    // Sets the largest amount of memory kept for reuse. 0 disables the cache.
+    static void configure(std::size_t max_bytes_cached) {
+        auto &pool = instance();
+        pool.m_max_bytes_cached = max_bytes_cached;
+        pool.trim();
+    }
+
+    //--------------------------------------------------------------------------
+
+    static void *allocate(std::size_t n) {
+        auto &pool = instance();
+        auto size_class = class_of(n);
+        auto size = NCLASSES == size_class ? n : class_size(size_class);
+
+        pool.m_n_allocations.fetch_add(1, std::memory_order_relaxed);
+        auto bytes_in_use = pool.m_bytes_in_use.fetch_add(size, std::memory_order_relaxed) + size;
+        auto max_bytes_in_use = pool.m_max_bytes_in_use.load(std::memory_order_relaxed);
+        while (bytes_in_use > max_bytes_in_use
+               && !pool.m_max_bytes_in_use.compare_exchange_weak(max_bytes_in_use, bytes_in_use, std::memory_order_relaxed)) { /* nothing */ }
+
+        if (NCLASSES != size_class) {
+            auto &free_list = pool.m_free_lists[size_class];
+            std::lock_guard<std::mutex> lock(free_list.mutex);
+            if (!free_list.blocks.empty()) {
+                auto *p = free_list.blocks.back();
+                free_list.blocks.pop_back();
+                pool.m_bytes_cached.fetch_sub(size, std::memory_order_relaxed);
+                pool.m_n_reused.fetch_add(1, std::memory_order_relaxed);
+                return p;
+            }
+        }
+
+        return ::operator new(size);
+    }
+
+    //--------------------------------------------------------------------------
+    // n needs to be the size given to allocate()
+    static void deallocate(void *p, std::size_t n) noexcept {
+        auto &pool = instance();
+        auto size_class = class_of(n);
+        auto size = NCLASSES == size_class ? n : class_size(size_class);
+
+        pool.m_bytes_in_use.fetch_sub(size, std::memory_order_relaxed);
+
+        // Room in the cache is reserved first, so concurrent callers cannot exceed the limit together
+        if (NCLASSES != size_class
+            && pool.m_bytes_cached.fetch_add(size, std::memory_order_relaxed) + size <= pool.m_max_bytes_cached.load(std::memory_order_relaxed)) {
+            auto &free_list = pool.m_free_lists[size_class];
+            std::lock_guard<std::mutex> lock(free_list.mutex);
+            try {
+                free_list.blocks.push_back(p);
+                return;
+            } catch (const std::bad_alloc &) {
+                // The block goes back to the heap instead
+            }
+        }
+        if (NCLASSES != size_class) pool.m_bytes_cached.fetch_sub(size, std::memory_order_relaxed);
+
+        ::operator delete(p);
+    }
+
+    //--------------------------------------------------------------------------
+
+    static buffer_pool_statistics get_statistics() {
+        auto &pool = instance();
+        buffer_pool_statistics statistics;
+        statistics.n_allocations = pool.m_n_allocations.load(std::memory_order_relaxed);
+        statistics.n_reused = pool.m_n_reused.load(std::memory_order_relaxed);
+        statistics.bytes_in_use = pool.m_bytes_in_use.load(std::memory_order_relaxed);
+        statistics.max_bytes_in_use = pool.m_max_bytes_in_use.load(std::memory_order_relaxed);
+        statistics.bytes_cached = pool.m_bytes_cached.load(std::memory_order_relaxed);
+        statistics.max_bytes_cached = pool.m_max_bytes_cached.load(std::memory_order_relaxed);
+        return statistics;
+    }
+
+private:
+    //--------------------------------------------------------------------------
+
+    // Each size class has a lock of its own, so sessions exchanging messages of different sizes
+    // do not wait for each other
+    struct free_list {
+        std::mutex mutex;
+        std::vector<void *> blocks;
+    };
+
+    static buffer_pool &instance() {
+        static buffer_pool pool;
+        return pool;
+    }
+
+    // The index of the smallest class holding n bytes, or NCLASSES if there is none
+    static std::size_t class_of(std::size_t n) {
+        for (std::size_t size_class = 0; size_class < NCLASSES; size_class++) {
+            if (n <= class_size(size_class)) return size_class;
+        }
+        return NCLASSES;
+    }
+
+    static std::size_t class_size(std::size_t size_class) {
+        return std::size_t(1) << (MINCLASSBITS + size_class);
+    }
+
+    // Releases cached blocks above the limit, largest first
+    void trim() {
+        for (std::size_t size_class = NCLASSES; size_class > 0; size_class--) {
+            auto &free_list = m_free_lists[size_class - 1];
+            std::lock_guard<std::mutex> lock(free_list.mutex);
+            while (!free_list.blocks.empty() && m_bytes_cached.load(std::memory_order_relaxed) > m_max_bytes_cached.load(std::memory_order_relaxed)) {
+                ::operator delete(free_list.blocks.back());
+                free_list.blocks.pop_back();
+                m_bytes_cached.fetch_sub(class_size(size_class - 1), std::memory_order_relaxed);
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    // Data
+
+    free_list m_free_lists[NCLASSES];
+
+    std::atomic<std::size_t> m_n_allocations{0};
+    std::atomic<std::size_t> m_n_reused{0};
+    std::atomic<std::size_t> m_bytes_in_use{0};
+    std::atomic<std::size_t> m_max_bytes_in_use{0};
+    std::atomic<std::size_t> m_bytes_cached{0};
+    std::atomic<std::size_t> m_max_bytes_cached{std::size_t(256) * 1024 * 1024};
+};
+
+/******************************************************************************************/
+////////////////////////////////////////////////////////////////////////////////////////////
+/******************************************************************************************/
+/**
+ * Takes the memory of message buffers from the buffer pool. Stateless, so it can be
+ * default-constructed by beast::basic_flat_buffer.
+ */
+template<typename T>
+class pooled_buffer_allocator {
+public:
+    using value_type = T;
+
+    pooled_buffer_allocator() = default;
+
+    template<typename U>
+    pooled_buffer_allocator(const pooled_buffer_allocator<U> &) noexcept { /* nothing */ }
+
+    T *allocate(std::size_t n) {
+        return static_cast<T *>(buffer_pool::allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T *p, std::size_t n) noexcept {
+        buffer_pool::deallocate(p, n * sizeof(T));
+    }
+
+    template<typename U>
+    bool operator==(const pooled_buffer_allocator<U> &) const noexcept { return true; }
+
+    template<typename U>
+    bool operator!=(const pooled_buffer_allocator<U> &) const noexcept { return false; }
+};
+
+/******************************************************************************************/
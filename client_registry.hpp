@@ -0,0 +1,167 @@
+/**
+ * @file client_registry.hpp
+ */
+
+/*
+ * The following license applies to the code in this file:
+ *
+ * **************************************************************************
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * **************************************************************************
+ *
+ * Author: Dr. Rüdiger Berlich of Gemfony scientific UG (haftungsbeschraenkt)
+ * See http://www.gemfony.eu for further information.
+ *
+ * This code is based on the Beast Websocket library by Vinnie Falco.
+ */
+
+#pragma once
+
+/******************************************************************************************/
+/*
+ * Per-client statistics of the server. Clients introduce themselves with their HELLO frame
+ * (id, number of cores, and the speed measured by a short benchmark at start-up). From then
+ * on, the registry keeps track of the work each client completes and the time it spends on
+ * it, so the server can tell fast from slow clients: Fast clients start out with larger work
+ * items, and slow clients receive no new work at the end of a run, where they would only
+ * delay the last results. Clients are identified by their resume token, which stays the same
+ * across reconnects.
+ */
+
+// Standard headers go here
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+// Boost headers go here
+// Nothing
+
+// Our own headers go here
+#include "misc.hpp"
+
+/******************************************************************************************/
+
+/** @brief What the server knows about a client */
+struct client_statistics {
+    client_hello hello; ///< As sent with the latest connection
+    std::size_t n_connections = 0;
+    std::size_t n_items = 0; ///< The number of results delivered
+    std::size_t n_units = 0; ///< The number of containers making up these results
+    double processing_time = 0.; ///< The time in seconds the client spent on these results
+
+    /** @brief Containers per second of processing time. 0 if nothing is known yet */
+    [[nodiscard]] double speed() const noexcept {
+        return processing_time > 0. ? double(n_units) / processing_time : 0.;
+    }
+};
+
+/******************************************************************************************/
+////////////////////////////////////////////////////////////////////////////////////////////
+/******************************************************************************************/
+/**
+ * Keeps statistics of all clients seen in a run. Thread-safe.
+ */
+class client_registry {
+public:
+    /** @brief The number of results needed before the speed of a client is taken into account */
+    static constexpr std::size_t MINRESULTS = 3;
+
+    /** @brief Clients slower than slow_fraction times the median speed count as slow. 0 disables this */
+    explicit client_registry(double slow_fraction)
+        : m_slow_fraction(slow_fraction) { /* nothing */ }
+
+    client_registry(const client_registry &) = delete;
+    client_registry &operator=(const client_registry &) = delete;
+
+    /** @brief Registers a new connection of a client */
+    void sign_on(const client_hello &hello) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto &stats = m_clients[hello.resume_token];
+        stats.hello = hello;
+        stats.n_connections++;
+    }
+
+    /** @brief Takes note of a result delivered by a client */
+    void record(std::uint64_t resume_token, std::size_t n_units, double processing_time) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_clients.find(resume_token);
+        if (it == m_clients.end()) return;
+
+        it->second.n_items++;
+        it->second.n_units += n_units;
+        it->second.processing_time += processing_time;
+    }
+
+    /**
+     * The speed of a client relative to the median speed of all clients with enough results.
+     * Returns 1 as long as too little is known.
+     */
+    double relative_speed(std::uint64_t resume_token) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_clients.find(resume_token);
+        if (it == m_clients.end() || it->second.n_items < MINRESULTS) return 1.;
+
+        std::vector<double> speeds;
+        for (const auto &client: m_clients) {
+            if (client.second.n_items >= MINRESULTS) speeds.push_back(client.second.speed());
+        }
+
+        auto median_it = speeds.begin() + speeds.size() / 2;
+        std::nth_element(speeds.begin(), median_it, speeds.end());
+        return *median_it > 0. ? it->second.speed() / *median_it : 1.;
+    }
+
+    /** @brief Whether a client is too slow to be given work at the end of a run */
+    bool is_slow(std::uint64_t resume_token) const {
+        return m_slow_fraction > 0. && relative_speed(resume_token) < m_slow_fraction;
+    }
+
+    /** @brief Prints one line per client */
+    void report(std::ostream &o) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const auto &client: m_clients) {
+            const auto &stats = client.second;
+            o
+                    << "client_registry: Client " << stats.hello.client_id << " (" << stats.hello.n_cores
+                    << " cores, benchmark: " << stats.hello.speed << " values/s, " << stats.n_connections
+                    << " connections): " << stats.n_items << " results of " << stats.n_units << " containers, "
+                    << stats.speed() << " containers/s while processing" << std::endl;
+        }
+    }
+
+private:
+    double m_slow_fraction;
+
+    mutable std::mutex m_mutex;
+    std::map<std::uint64_t, client_statistics> m_clients; ///< By resume token
+};
+
+/******************************************************************************************/
@@ -0,0 +1,349 @@
+/**
+ * @file compression.cpp
+ */
+
+/*
+ * The following license applies to the code in this file:
+ *
+ * **************************************************************************
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * **************************************************************************
+ *
+ * Author: Dr. Rüdiger Berlich of Gemfony scientific UG (haftungsbeschraenkt)
+ * See http://www.gemfony.eu for further information.
+ *
+ * This code is based on the Beast Websocket library by Vinnie Falco.
+ */
+
+#include "compression.hpp"
+
+// Standard headers go here
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+// Boost headers go here
+#include <boost/lexical_cast.hpp>
+
+// Third-party headers go here
+#include <zlib.h>
+#if defined(ESTRAY_LZ4)
+#include <lz4.h>
+#endif
+#if defined(ESTRAY_ZSTD)
+#include <zstd.h>
+#endif
+
+/******************************************************************************************/
+
+namespace {
+
+/**
+ * Applies the filter to a message. The "shuffle" part stores byte b of word i at position b*n+i
+ * (n being the number of complete 8-byte words), the "xor" part replaces each word by its XOR with
+ * the preceding (original) word. Trailing bytes are copied unchanged.
+ */
+void encode_filter(const char *in, std::size_t size, char *out, compression_filter filter) {
+    const bool use_xor = compression_filter::xor_delta == filter || compression_filter::xor_shuffle == filter;
+    const bool use_shuffle = compression_filter::shuffle == filter || compression_filter::xor_shuffle == filter;
+    const std::size_t n_words = size / sizeof(std::uint64_t);
+
+    std::uint64_t previous = 0;
+    for (std::size_t i = 0; i < n_words; i++) {
+        std::uint64_t word;
+        std::memcpy(&word, in + i * sizeof(word), sizeof(word));
+
+        std::uint64_t encoded = use_xor ? (word ^ previous) : word;
+        previous = word;
+
+        if (use_shuffle) {
+            const auto *bytes = reinterpret_cast<const char *>(&encoded);
+            for (std::size_t b = 0; b < sizeof(encoded); b++) {
+                out[b * n_words + i] = bytes[b];
+            }
+        } else {
+            std::memcpy(out + i * sizeof(encoded), &encoded, sizeof(encoded));
+        }
+    }
+
+    const std::size_t n_tail = size - n_words * sizeof(std::uint64_t);
+    std::memcpy(out + n_words * sizeof(std::uint64_t), in + n_words * sizeof(std::uint64_t), n_tail);
+}
+
+/** @brief The inverse of encode_filter() */
+void decode_filter(const char *in, std::size_t size, char *out, compression_filter filter) {
+    const bool use_xor = compression_filter::xor_delta == filter || compression_filter::xor_shuffle == filter;
+    const bool use_shuffle = compression_filter::shuffle == filter || compression_filter::xor_shuffle == filter;
+    const std::size_t n_words = size / sizeof(std::uint64_t);
+
+    std::uint64_t previous = 0;
+    for (std::size_t i = 0; i < n_words; i++) {
+        std::uint64_t encoded;
+        if (use_shuffle) {
+            auto *bytes = reinterpret_cast<char *>(&encoded);
+            for (std::size_t b = 0; b < sizeof(encoded); b++) {
+                bytes[b] = in[b * n_words + i];
+            }
+        } else {
+            std::memcpy(&encoded, in + i * sizeof(encoded), sizeof(encoded));
+        }
+
+        std::uint64_t word = use_xor ? (encoded ^ previous) : encoded;
+        previous = word;
+
+        std::memcpy(out + i * sizeof(word), &word, sizeof(word));
+    }
+
+    const std::size_t n_tail = size - n_words * sizeof(std::uint64_t);
+    std::memcpy(out + n_words * sizeof(std::uint64_t), in + n_words * sizeof(std::uint64_t), n_tail);
+}
+
+/******************************************************************************************/
+
+std::size_t codec_bound(compression_codec codec, std::size_t size) {
+    switch (codec) {
+        case compression_codec::zlib:
+            return compressBound(static_cast<uLong>(size));
+#if defined(ESTRAY_LZ4)
+        case compression_codec::lz4:
+            return static_cast<std::size_t>(LZ4_compressBound(static_cast<int>(size)));
+#endif
+#if defined(ESTRAY_ZSTD)
+        case compression_codec::zstd:
+            return ZSTD_compressBound(size);
+#endif
+        default:
+            return size;
+    }
+}
+
+/******************************************************************************************/
+
+/** @brief Compresses size bytes into target. Returns 0 if this is not possible */
+std::size_t codec_compress(
+        const compression_settings &settings, const char *data, std::size_t size, char *target, std::size_t capacity
+) {
+    switch (settings.codec) {
+        case compression_codec::zlib: {
+            auto target_size = static_cast<uLongf>(capacity);
+            auto rc = compress2(
+                    reinterpret_cast<Bytef *>(target), &target_size,
+                    reinterpret_cast<const Bytef *>(data), static_cast<uLong>(size),
+                    0 == settings.level ? Z_DEFAULT_COMPRESSION : settings.level);
+            return Z_OK == rc ? static_cast<std::size_t>(target_size) : 0;
+        }
+
+#if defined(ESTRAY_LZ4)
+        case compression_codec::lz4: {
+            auto rc = LZ4_compress_default(data, target, static_cast<int>(size), static_cast<int>(capacity));
+            return rc > 0 ? static_cast<std::size_t>(rc) : 0;
+        }
+#endif
+
+#if defined(ESTRAY_ZSTD)
+        case compression_codec::zstd: {
+            auto rc = ZSTD_compress(target, capacity, data, size, settings.level);
+            return ZSTD_isError(rc) ? 0 : rc;
+        }
+#endif
+
+        default:
+            return 0;
+    }
+}
+
+/******************************************************************************************/
+
+/** @brief Restores exactly raw_size bytes into target. Throws on error */
+void codec_decompress(
+        compression_codec codec, const char *data, std::size_t size, char *target, std::size_t raw_size
+) {
+    bool success = false;
+
+    switch (codec) {
+        case compression_codec::zlib: {
+            auto target_size = static_cast<uLongf>(raw_size);
+            auto rc = uncompress(
+                    reinterpret_cast<Bytef *>(target), &target_size,
+                    reinterpret_cast<const Bytef *>(data), static_cast<uLong>(size));
+            success = (Z_OK == rc && target_size == raw_size);
+        }
+            break;
+
+#if defined(ESTRAY_LZ4)
+        case compression_codec::lz4: {
+            auto rc = LZ4_decompress_safe(data, target, static_cast<int>(size), static_cast<int>(raw_size));
+            success = (rc >= 0 && static_cast<std::size_t>(rc) == raw_size);
+        }
+            break;
+#endif
+
+#if defined(ESTRAY_ZSTD)
+        case compression_codec::zstd: {
+            auto rc = ZSTD_decompress(target, raw_size, data, size);
+            success = (!ZSTD_isError(rc) && rc == raw_size);
+        }
+            break;
+#endif
+
+        default: {
+            throw std::runtime_error(
+                    "message_compressor::decompress(): Got unknown or unavailable codec " +
+                    boost::lexical_cast<std::string>(codec));
+        }
+    }
+
+    if (!success) {
+        throw std::runtime_error("message_compressor::decompress(): Message is corrupt");
+    }
+}
+
+} // anonymous namespace
+
+/******************************************************************************************/
+
+bool codec_available(compression_codec codec) {
+    switch (codec) {
+        case compression_codec::none:
+        case compression_codec::zlib:
+            return true;
+        case compression_codec::lz4:
+#if defined(ESTRAY_LZ4)
+            return true;
+#else
+            return false;
+#endif
+        case compression_codec::zstd:
+#if defined(ESTRAY_ZSTD)
+            return true;
+#else
+            return false;
+#endif
+    }
+
+    return false;
+}
+
+/******************************************************************************************/
+
+bool message_compressor::should_compress(std::size_t size) const noexcept {
+    return compression_codec::none != m_settings.codec && size > 0 && size >= m_settings.threshold;
+}
+
+/******************************************************************************************/
+
+std::size_t message_compressor::max_compressed_size(std::size_t raw_size) const {
+    return sizeof(compressed_message_header) + codec_bound(m_settings.codec, raw_size);
+}
+
+/******************************************************************************************/
+
+std::size_t message_compressor::compress(const char *data, std::size_t size, char *target) {
+    if (!should_compress(size)) return 0;
+
+    // Filters work on a copy, so the original message remains untouched
+    const char *source = data;
+    if (compression_filter::none != m_settings.filter) {
+        m_scratch.resize(size);
+        encode_filter(data, size, m_scratch.data(), m_settings.filter);
+        source = m_scratch.data();
+    }
+
+    auto n_compressed = codec_compress(
+            m_settings, source, size,
+            target + sizeof(compressed_message_header), codec_bound(m_settings.codec, size));
+
+    // There is no point in sending a compressed message that is not smaller than the original
+    if (0 == n_compressed || sizeof(compressed_message_header) + n_compressed >= size) return 0;
+
+    compressed_message_header header{};
+    std::memcpy(header.magic, COMPRESSIONMAGIC, sizeof(header.magic));
+    header.codec = static_cast<std::uint16_t>(m_settings.codec);
+    header.filter = static_cast<std::uint16_t>(m_settings.filter);
+    header.raw_size = size;
+    std::memcpy(target, &header, sizeof(header));
+
+    return sizeof(header) + n_compressed;
+}
+
+/******************************************************************************************/
+
+bool message_compressor::is_compressed(const char *data, std::size_t size) {
+    return size >= sizeof(compressed_message_header)
+           && 0 == std::memcmp(data, COMPRESSIONMAGIC, sizeof(compressed_message_header::magic));
+}
+
+/******************************************************************************************/
+
+std::size_t message_compressor::raw_size(const char *data, std::size_t size) {
+    if (!is_compressed(data, size)) {
+        throw std::runtime_error("message_compressor::raw_size(): Message is not compressed");
+    }
+
+    compressed_message_header header{};
+    std::memcpy(&header, data, sizeof(header));
+
+    if (header.raw_size > MAXDECOMPRESSEDSIZE) {
+        throw std::runtime_error(
+                "message_compressor::raw_size(): Invalid size " + std::to_string(header.raw_size));
+    }
+
+    return static_cast<std::size_t>(header.raw_size);
+}
+
+/******************************************************************************************/
+
+compression_settings message_compressor::decompress(const char *data, std::size_t size, char *target) {
+    auto n_raw = raw_size(data, size);
+
+    compressed_message_header header{};
+    std::memcpy(&header, data, sizeof(header));
+
+    compression_settings used;
+    used.codec = static_cast<compression_codec>(header.codec);
+    used.filter = static_cast<compression_filter>(header.filter);
+
+    if (used.filter > compression_filter::xor_shuffle) {
+        throw std::runtime_error(
+                "message_compressor::decompress(): Got unknown filter " + boost::lexical_cast<std::string>(used.filter));
+    }
+
+    const char *body = data + sizeof(header);
+    const std::size_t body_size = size - sizeof(header);
+
+    if (compression_filter::none == used.filter) {
+        codec_decompress(used.codec, body, body_size, target, n_raw);
+    } else {
+        m_scratch.resize(n_raw);
+        codec_decompress(used.codec, body, body_size, m_scratch.data(), n_raw);
+        decode_filter(m_scratch.data(), n_raw, target, used.filter);
+    }
+
+    return used;
+}
+
+/******************************************************************************************/
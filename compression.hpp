@@ -0,0 +1,191 @@
+/**
+ * @file compression.hpp
+ */
+
+/*
+ * The following license applies to the code in this file:
+ *
+ * **************************************************************************
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * **************************************************************************
+ *
+ * Author: Dr. Rüdiger Berlich of Gemfony scientific UG (haftungsbeschraenkt)
+ * See http://www.gemfony.eu for further information.
+ *
+ * This code is based on the Beast Websocket library by Vinnie Falco.
+ */
+
+#pragma once
+
+/******************************************************************************************/
+/*
+ * Optional compression of messages on the wire. Messages above a size threshold are
+ * (reversibly) filtered and compressed, and are sent with a small header naming codec,
+ * filter and the original size, so the receiving side can restore them without any
+ * further configuration. Messages that do not become smaller are sent unchanged.
+ *
+ * The filters target containers of doubles, which compress poorly with generic codecs:
+ * "shuffle" groups the n-th bytes of all 8-byte words, so that the similar exponent bytes
+ * end up next to each other, "xor_delta" replaces each word by its XOR with its predecessor,
+ * and "xor_shuffle" applies both. zlib is always available, LZ4 and zstd only if enabled in
+ * CMakeLists.txt (ESTRAY_LZ4 / ESTRAY_ZSTD).
+ */
+
+// Standard headers go here
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Boost headers go here
+// Nothing
+
+// Our own headers go here
+#include "misc.hpp"
+
+/******************************************************************************************/
+
+const char COMPRESSIONMAGIC[] = "#ESTCMP#";
+
+/** @brief The largest message we are willing to restore (protects against corrupt headers) */
+const std::uint64_t MAXDECOMPRESSEDSIZE = std::uint64_t(1) << 30;
+
+/** @brief The header preceding each compressed message */
+struct compressed_message_header {
+    char magic[8]; ///< Always holds COMPRESSIONMAGIC (without the trailing zero)
+    std::uint16_t codec; ///< The compression_codec used
+    std::uint16_t filter; ///< The compression_filter applied before compression
+    std::uint32_t reserved; ///< Currently unused, always 0
+    std::uint64_t raw_size; ///< The size of the original message
+};
+
+static_assert(sizeof(COMPRESSIONMAGIC) - 1 == sizeof(compressed_message_header::magic), "Invalid magic size");
+
+/** @brief The settings of the compression of outgoing messages */
+struct compression_settings {
+    compression_codec codec = compression_codec::none;
+    compression_filter filter = compression_filter::none;
+    std::size_t threshold = 0; ///< Messages smaller than this are sent uncompressed
+    int level = 0; ///< The compression level of zlib and zstd. 0 means "codec default"
+};
+
+/** @brief Checks whether support for a codec was compiled in */
+bool codec_available(compression_codec codec);
+
+/******************************************************************************************/
+////////////////////////////////////////////////////////////////////////////////////////////
+/******************************************************************************************/
+/**
+ * Compresses and restores messages. Objects hold scratch memory for the filters, so each
+ * session or client needs its own instance. Not thread-safe.
+ */
+class message_compressor {
+public:
+    message_compressor() = default;
+
+    explicit message_compressor(const compression_settings &settings)
+        : m_settings(settings) { /* nothing */ }
+
+    const compression_settings &get_settings() const noexcept {
+        return m_settings;
+    }
+
+    void set_settings(const compression_settings &settings) noexcept {
+        m_settings = settings;
+    }
+
+    /** @brief Checks whether a message of the given size would be compressed */
+    bool should_compress(std::size_t size) const noexcept;
+
+    /** @brief The capacity needed by compress() for a message of the given size */
+    std::size_t max_compressed_size(std::size_t raw_size) const;
+
+    /**
+     * Compresses a message into target, which must hold max_compressed_size(size) bytes. Returns the
+     * size of the compressed message, or 0 if the message should be sent unchanged.
+     */
+    std::size_t compress(const char *data, std::size_t size, char *target);
+
+    /** @brief Checks whether a message was created by compress() */
+    static bool is_compressed(const char *data, std::size_t size);
+
+    /** @brief The size of the original message. Throws if the header is invalid */
+    static std::size_t raw_size(const char *data, std::size_t size);
+
+    /**
+     * Restores a compressed message into target, which must hold raw_size(data, size) bytes.
+     * Returns the codec and filter used by the sender. Throws on corrupt messages.
+     */
+    compression_settings decompress(const char *data, std::size_t size, char *target);
+
+private:
+    compression_settings m_settings;
+    std::vector<char> m_scratch; ///< Holds filtered messages
+};
+
+/******************************************************************************************/
+////////////////////////////////////////////////////////////////////////////////////////////
+/******************************************************************************************/
+/**
+ * Helpers for contiguous dynamic buffers (such as beast::flat_buffer). The result ends up in
+ * buffer, scratch receives the former content of buffer. Both return whether anything was done.
+ */
+
+template<typename buffer_t>
+bool compress_buffer(message_compressor &compressor, buffer_t &buffer, buffer_t &scratch) {
+    auto in_data = buffer.data();
+    if (!compressor.should_compress(in_data.size())) return false;
+
+    scratch.consume(scratch.size());
+    auto target = scratch.prepare(compressor.max_compressed_size(in_data.size()));
+
+    auto n_compressed = compressor.compress(
+            static_cast<const char *>(in_data.data()), in_data.size(), static_cast<char *>(target.data()));
+    if (0 == n_compressed) return false;
+
+    scratch.commit(n_compressed);
+    swap(buffer, scratch);
+    return true;
+}
+
+template<typename buffer_t>
+bool decompress_buffer(message_compressor &compressor, buffer_t &buffer, buffer_t &scratch, compression_settings &used) {
+    auto in_data = buffer.data();
+    const auto *data = static_cast<const char *>(in_data.data());
+    if (!message_compressor::is_compressed(data, in_data.size())) return false;
+
+    auto raw_size = message_compressor::raw_size(data, in_data.size());
+    scratch.consume(scratch.size());
+    auto target = scratch.prepare(raw_size);
+
+    used = compressor.decompress(data, in_data.size(), static_cast<char *>(target.data()));
+
+    scratch.commit(raw_size);
+    swap(buffer, scratch);
+    return true;
+}
+
+/******************************************************************************************/
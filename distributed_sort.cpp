@@ -0,0 +1,302 @@
+/**
+ * @file distributed_sort.cpp
+ */
+
+/*
+ * The following license applies to the code in this file:
+ *
+ * **************************************************************************
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * **************************************************************************
+ *
+ * Author: Dr. Rüdiger Berlich of Gemfony scientific UG (haftungsbeschraenkt)
+ * See http://www.gemfony.eu for further information.
+ *
+ * This code is based on the Beast Websocket library by Vinnie Falco.
+ */
+
+#include "distributed_sort.hpp"
+
+// Standard headers go here
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+// Boost headers go here
+#include <boost/endian/conversion.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+// Our own headers go here
+#include "payload.hpp"
+#include "result_sink.hpp"
+
+/******************************************************************************************/
+
+namespace {
+
+/** @brief A sorted run, either inside the mapped result file or in memory owned by run_set */
+struct sorted_run {
+    const double *begin = nullptr;
+    const double *end = nullptr;
+};
+
+/** @brief All runs of a result file */
+struct run_set {
+    std::vector<sorted_run> runs;
+    std::deque<std::vector<double>> owned; ///< Runs that could not be used in place
+    std::uint64_t n_values = 0;
+};
+
+/**
+ * Collects the runs of a mapped result file. Flat containers are used in place (if aligned),
+ * serialized containers need to be restored and are copied.
+ */
+void collect_runs(const char *data, std::size_t size, const std::string &run_path, run_set &set) {
+    if (size < RESULTFILEMAGICLENGTH || 0 != std::memcmp(data, RESULTFILEMAGIC, RESULTFILEMAGICLENGTH)) {
+        throw std::runtime_error("merge_sorted_runs(): " + run_path + " is not a result file");
+    }
+
+    std::size_t position = RESULTFILEMAGICLENGTH;
+    while (position + sizeof(std::uint64_t) <= size) {
+        std::uint64_t record_size = 0;
+        std::memcpy(&record_size, data + position, sizeof(record_size));
+        record_size = boost::endian::little_to_native(record_size);
+        position += sizeof(record_size);
+
+        if (record_size > size - position) {
+            throw std::runtime_error("merge_sorted_runs(): Truncated record in " + run_path);
+        }
+
+        const char *record = data + position;
+        position += record_size;
+
+        // The view only reads from the (read-only) mapping
+        flat_container_view view(const_cast<char *>(record), record_size);
+        if (view.valid()) {
+            if (const double *values = view.data()) {
+                set.runs.push_back(sorted_run{values, values + view.size()});
+            } else {
+                set.owned.emplace_back(view.size());
+                view.copy_values(set.owned.back().data());
+                set.runs.push_back(sorted_run{set.owned.back().data(), set.owned.back().data() + view.size()});
+            }
+        } else {
+            command_container container{payload_command::NONE};
+            container.from_string(std::string(record, record_size));
+
+            const auto *payload_ptr = dynamic_cast<const random_container_payload *>(container.get_payload());
+            if (!payload_ptr) {
+                throw std::runtime_error("merge_sorted_runs(): " + run_path + " holds a result that is not a container");
+            }
+
+            set.owned.emplace_back(payload_ptr->size());
+            auto &values = set.owned.back();
+            for (std::size_t i = 0; i < values.size(); i++) {
+                values[i] = payload_ptr->member(i)->value();
+            }
+            set.runs.push_back(sorted_run{values.data(), values.data() + values.size()});
+        }
+
+        set.n_values += set.runs.back().end - set.runs.back().begin;
+    }
+}
+
+/**
+ * Picks n_parts - 1 splitters from regular samples of all runs, so the parts of the merge
+ * hold similar numbers of values.
+ */
+std::vector<double> pick_splitters(const std::vector<sorted_run> &runs, std::size_t n_parts) {
+    const std::size_t n_samples_per_run = 4 * n_parts;
+
+    std::vector<double> samples;
+    for (const auto &run: runs) {
+        auto length = static_cast<std::size_t>(run.end - run.begin);
+        if (0 == length) continue;
+        for (std::size_t i = 0; i < n_samples_per_run; i++) {
+            samples.push_back(run.begin[(i * length) / n_samples_per_run]);
+        }
+    }
+    std::sort(samples.begin(), samples.end());
+
+    std::vector<double> splitters;
+    for (std::size_t p = 1; p < n_parts && !samples.empty(); p++) {
+        splitters.push_back(samples[(p * samples.size()) / n_parts]);
+    }
+    return splitters;
+}
+
+/** @brief A k-way merge of the given run sections into target */
+void merge_runs(const std::vector<sorted_run> &runs, double *target) {
+    using cursor = std::pair<double, std::size_t>; // The current value and the index of its run
+    std::priority_queue<cursor, std::vector<cursor>, std::greater<cursor>> heads;
+
+    std::vector<const double *> positions(runs.size());
+    for (std::size_t r = 0; r < runs.size(); r++) {
+        positions[r] = runs[r].begin;
+        if (positions[r] != runs[r].end) heads.emplace(*positions[r], r);
+    }
+
+    while (!heads.empty()) {
+        auto r = heads.top().second;
+        *target++ = heads.top().first;
+        heads.pop();
+
+        if (++positions[r] != runs[r].end) heads.emplace(*positions[r], r);
+    }
+}
+
+} // anonymous namespace
+
+/******************************************************************************************/
+////////////////////////////////////////////////////////////////////////////////////////////
+/******************************************************************************************/
+
+sort_input_reader::sort_input_reader(const std::string &path)
+    : m_stream(path, std::ios::in | std::ios::binary)
+    , m_path(path)
+{
+    if (!m_stream) {
+        throw std::runtime_error("sort_input_reader: Could not open " + path + " for reading");
+    }
+
+    auto file_size = boost::filesystem::file_size(path);
+    if (file_size % sizeof(double) != 0) {
+        throw std::runtime_error("sort_input_reader: The size of " + path + " is not a multiple of " + std::to_string(sizeof(double)));
+    }
+    m_n_values = file_size / sizeof(double);
+}
+
+/******************************************************************************************/
+
+bool sort_input_reader::next(std::vector<double> &values, std::size_t chunk_size) {
+    auto n_values = static_cast<std::size_t>(std::min<std::uint64_t>(chunk_size, m_n_values - m_n_read));
+    if (0 == n_values) return false;
+
+    values.resize(n_values);
+    if (!m_stream.read(reinterpret_cast<char *>(values.data()), static_cast<std::streamsize>(n_values * sizeof(double)))) {
+        throw std::runtime_error("sort_input_reader::next(): Could not read from " + m_path);
+    }
+
+    m_n_read += n_values;
+    return true;
+}
+
+/******************************************************************************************/
+
+sort_merge_summary merge_sorted_runs(
+        const std::string &run_path
+        , const std::string &output_path
+        , std::size_t n_threads
+) {
+    namespace bip = boost::interprocess;
+
+    auto start = std::chrono::steady_clock::now();
+    sort_merge_summary summary;
+
+    bip::file_mapping run_file(run_path.c_str(), bip::read_only);
+    bip::mapped_region run_region(run_file, bip::read_only);
+    run_region.advise(bip::mapped_region::advice_sequential);
+
+    run_set set;
+    collect_runs(static_cast<const char *>(run_region.get_address()), run_region.get_size(), run_path, set);
+    summary.n_runs = set.runs.size();
+    summary.n_values = set.n_values;
+
+    // Create the output file with its final size, so threads may write their parts independently
+    {
+        std::ofstream output(output_path, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!output) {
+            throw std::runtime_error("merge_sorted_runs(): Could not open " + output_path + " for writing");
+        }
+    }
+    boost::filesystem::resize_file(output_path, set.n_values * sizeof(double));
+
+    if (0 == set.n_values) {
+        summary.sorted = true;
+        summary.merge_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return summary;
+    }
+
+    // Tiny inputs are not worth the threads
+    if (0 == n_threads) n_threads = std::thread::hardware_concurrency();
+    n_threads = std::max<std::size_t>(1, std::min<std::size_t>(n_threads, set.n_values / 4096 + 1));
+    summary.n_threads = n_threads;
+
+    // Part p of each run holds the values in [splitters[p-1], splitters[p])
+    auto splitters = pick_splitters(set.runs, n_threads);
+    std::vector<std::vector<sorted_run>> parts(n_threads, std::vector<sorted_run>(set.runs.size()));
+    std::vector<std::uint64_t> offsets(n_threads + 1, 0);
+    for (std::size_t r = 0; r < set.runs.size(); r++) {
+        const double *part_begin = set.runs[r].begin;
+        for (std::size_t p = 0; p < n_threads; p++) {
+            const double *part_end = p < splitters.size()
+                                     ? std::lower_bound(part_begin, set.runs[r].end, splitters[p])
+                                     : set.runs[r].end;
+            parts[p][r] = sorted_run{part_begin, part_end};
+            offsets[p + 1] += part_end - part_begin;
+            part_begin = part_end;
+        }
+    }
+    for (std::size_t p = 0; p < n_threads; p++) offsets[p + 1] += offsets[p];
+
+    bip::file_mapping output_file(output_path.c_str(), bip::read_write);
+    bip::mapped_region output_region(output_file, bip::read_write);
+    auto *output_values = static_cast<double *>(output_region.get_address());
+
+    std::vector<char> part_sorted(n_threads, 0);
+    std::vector<std::thread> merge_threads;
+    merge_threads.reserve(n_threads);
+    for (std::size_t p = 0; p < n_threads; p++) {
+        merge_threads.emplace_back([&, p]() {
+            merge_runs(parts[p], output_values + offsets[p]);
+            part_sorted[p] = std::is_sorted(output_values + offsets[p], output_values + offsets[p + 1]);
+        });
+    }
+    for (auto &t: merge_threads) { t.join(); }
+
+    // Each part is sorted by itself, so only the boundaries between parts remain to be checked
+    summary.sorted = std::all_of(part_sorted.begin(), part_sorted.end(), [](char s) { return 0 != s; });
+    for (std::size_t p = 1; p < n_threads && summary.sorted; p++) {
+        if (offsets[p] > 0 && offsets[p] < set.n_values && output_values[offsets[p]] < output_values[offsets[p] - 1]) {
+            summary.sorted = false;
+        }
+    }
+
+    output_region.flush();
+    summary.merge_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return summary;
+}
+
+/******************************************************************************************/
@@ -0,0 +1,133 @@
+/**
+ * @file distributed_sort.hpp
+ */
+
+/*
+ * The following license applies to the code in this file:
+ *
+ * **************************************************************************
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * **************************************************************************
+ *
+ * Author: Dr. Rüdiger Berlich of Gemfony scientific UG (haftungsbeschraenkt)
+ * See http://www.gemfony.eu for further information.
+ *
+ * This code is based on the Beast Websocket library by Vinnie Falco.
+ */
+
+#pragma once
+
+/******************************************************************************************/
+/*
+ * Support for using Estray as a distributed external sort: The server splits a large input
+ * (a file of doubles in native byte order, or random numbers) into containers, clients sort
+ * them, and the sorted runs are kept in a result file (see result_sink.hpp). Once all runs
+ * have been returned, the server merges them into a single sorted output file, again made up
+ * of doubles in native byte order.
+ *
+ * The merge reads the runs straight from the memory-mapped result file. It is parallelized by
+ * splitting the value range at splitters sampled from the runs: each thread performs a k-way
+ * merge of "its" part of every run and writes it to its own section of the (memory-mapped)
+ * output file, so no data needs to be exchanged between threads.
+ */
+
+// Standard headers go here
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Boost headers go here
+// Nothing
+
+// Our own headers go here
+// Nothing
+
+/******************************************************************************************/
+
+/** @brief The settings of the distributed sort */
+struct sort_settings {
+    std::string input_path; ///< A file of doubles. Random numbers are sorted if this is empty
+    std::string output_path; ///< The sorted output. The server does not sort if this is empty
+    std::size_t n_merge_threads = 0; ///< The number of threads of the final merge. 0 means "hardware_concurrency"
+};
+
+/** @brief The outcome of merge_sorted_runs() */
+struct sort_merge_summary {
+    std::size_t n_runs = 0;
+    std::uint64_t n_values = 0;
+    std::size_t n_threads = 0; ///< The number of threads actually used
+    double merge_time = 0.; ///< In seconds
+    bool sorted = false; ///< Whether the output was verified to be sorted
+};
+
+/******************************************************************************************/
+////////////////////////////////////////////////////////////////////////////////////////////
+/******************************************************************************************/
+/**
+ * Splits an input file of doubles into chunks. Not thread-safe.
+ */
+class sort_input_reader {
+public:
+    explicit sort_input_reader(const std::string &path);
+
+    sort_input_reader(const sort_input_reader &) = delete;
+    sort_input_reader &operator=(const sort_input_reader &) = delete;
+
+    /** @brief Reads up to chunk_size values. Returns false once the input is exhausted */
+    bool next(std::vector<double> &values, std::size_t chunk_size);
+
+    [[nodiscard]] std::uint64_t get_n_values() const noexcept {
+        return m_n_values;
+    }
+
+    /** @brief The number of chunks the input will be split into */
+    [[nodiscard]] std::size_t get_n_chunks(std::size_t chunk_size) const noexcept {
+        return static_cast<std::size_t>((m_n_values + chunk_size - 1) / chunk_size);
+    }
+
+private:
+    std::ifstream m_stream;
+    std::string m_path;
+    std::uint64_t m_n_values = 0;
+    std::uint64_t m_n_read = 0;
+};
+
+/******************************************************************************************/
+
+/**
+ * Merges the sorted runs stored in a result file into output_path. Runs may be flat containers
+ * or serialized random_container_payload objects. Throws if the file holds anything else.
+ */
+sort_merge_summary merge_sorted_runs(
+        const std::string &run_path
+        , const std::string &output_path
+        , std::size_t n_threads
+);
+
+/******************************************************************************************/
@@ -0,0 +1,177 @@
+/**
+ * @file fast_random.hpp
+ */
+
+/*
+ * The following license applies to the code in this file:
+ *
+ * **************************************************************************
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * **************************************************************************
+ *
+ * Author: Dr. Rüdiger Berlich of Gemfony scientific UG (haftungsbeschraenkt)
+ * See http://www.gemfony.eu for further information.
+ *
+ * This code is based on the Beast Websocket library by Vinnie Falco.
+ */
+
+#pragma once
+
+/******************************************************************************************/
+/*
+ * Bulk generation of normally distributed random numbers for the container producers.
+ * xoshiro256++ (Blackman / Vigna) is a small, fast engine with a 256-bit state, and the
+ * Box-Muller transform turns pairs of uniform numbers into pairs of normal numbers without
+ * any rejection loop. Numbers are produced in blocks: first all uniform numbers of a block,
+ * then the transform for the whole block. Both loops are free of branches and dependencies
+ * between iterations, so compilers may vectorize them (for the transform this requires a
+ * vector math library, e.g. glibc's libmvec with -O3 -ffast-math).
+ */
+
+// Standard headers go here
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+// Boost headers go here
+// Nothing
+
+// Our own headers go here
+// Nothing
+
+/******************************************************************************************/
+////////////////////////////////////////////////////////////////////////////////////////////
+/******************************************************************************************/
+/**
+ * The splitmix64 mixing function. Turns similar inputs (e.g. consecutive seeds) into
+ * unrelated outputs.
+ */
+inline std::uint64_t splitmix64(std::uint64_t x) noexcept {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30U)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27U)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31U);
+}
+
+/******************************************************************************************/
+////////////////////////////////////////////////////////////////////////////////////////////
+/******************************************************************************************/
+/**
+ * The xoshiro256++ engine. Satisfies the UniformRandomBitGenerator requirements, so it may
+ * also be used with the distributions of the standard library.
+ */
+class xoshiro256pp {
+public:
+    using result_type = std::uint64_t;
+
+    explicit xoshiro256pp(std::uint64_t seed) {
+        // The state is filled through splitmix64, as recommended by the authors
+        for (auto &s: m_state) {
+            s = splitmix64(seed);
+            seed += 0x9e3779b97f4a7c15ULL;
+        }
+    }
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+    result_type operator()() noexcept {
+        const std::uint64_t result = rotl(m_state[0] + m_state[3], 23) + m_state[0];
+        const std::uint64_t t = m_state[1] << 17U;
+
+        m_state[2] ^= m_state[0];
+        m_state[3] ^= m_state[1];
+        m_state[1] ^= m_state[2];
+        m_state[0] ^= m_state[3];
+        m_state[2] ^= t;
+        m_state[3] = rotl(m_state[3], 45);
+
+        return result;
+    }
+
+private:
+    static std::uint64_t rotl(std::uint64_t x, unsigned int k) noexcept {
+        return (x << k) | (x >> (64U - k));
+    }
+
+    std::array<std::uint64_t, 4> m_state{};
+};
+
+/******************************************************************************************/
+////////////////////////////////////////////////////////////////////////////////////////////
+/******************************************************************************************/
+/**
+ * Fills arrays with normally distributed random numbers (mean 0, standard deviation 1).
+ */
+class bulk_normal_generator {
+public:
+    explicit bulk_normal_generator(std::uint64_t seed) : m_engine(seed) { /* nothing */ }
+
+    void fill(double *target, std::size_t n) {
+        while (n >= 2 * BLOCKSIZE) {
+            fill_block(target, BLOCKSIZE);
+            target += 2 * BLOCKSIZE;
+            n -= 2 * BLOCKSIZE;
+        }
+
+        // The remainder. An odd last number uses only one half of its pair
+        std::array<double, 2 * BLOCKSIZE> tail{};
+        std::size_t n_pairs = (n + 1) / 2;
+        fill_block(tail.data(), n_pairs);
+        for (std::size_t i = 0; i < n; i++) target[i] = tail[i];
+    }
+
+private:
+    static constexpr std::size_t BLOCKSIZE = 256; ///< The number of pairs per block
+
+    // Produces n_pairs pairs of normal numbers
+    void fill_block(double *target, std::size_t n_pairs) {
+        constexpr double TWOTOTHEMINUS53 = 1. / 9007199254740992.;
+        constexpr double TWOPI = 6.283185307179586476925286766559;
+
+        // The radius needs uniform numbers in (0, 1], so the logarithm stays finite
+        for (std::size_t i = 0; i < n_pairs; i++) {
+            m_u1[i] = double((m_engine() >> 11U) + 1) * TWOTOTHEMINUS53;
+            m_u2[i] = double(m_engine() >> 11U) * TWOTOTHEMINUS53;
+        }
+
+        for (std::size_t i = 0; i < n_pairs; i++) {
+            const double radius = std::sqrt(-2. * std::log(m_u1[i]));
+            const double angle = TWOPI * m_u2[i];
+            target[2 * i] = radius * std::cos(angle);
+            target[2 * i + 1] = radius * std::sin(angle);
+        }
+    }
+
+    xoshiro256pp m_engine;
+    std::array<double, BLOCKSIZE> m_u1{};
+    std::array<double, BLOCKSIZE> m_u2{};
+};
+
+/******************************************************************************************/
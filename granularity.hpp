@@ -0,0 +1,132 @@
+/**
+ * @file granularity.hpp
+ */
+
+/*
+ * The following license applies to the code in this file:
+ *
+ * **************************************************************************
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * **************************************************************************
+ *
+ * Author: Dr. Rüdiger Berlich of Gemfony scientific UG (haftungsbeschraenkt)
+ * See http://www.gemfony.eu for further information.
+ *
+ * This code is based on the Beast Websocket library by Vinnie Falco.
+ */
+
+#pragma once
+
+/******************************************************************************************/
+/*
+ * Adaptive work granularity ("self-scheduling"). Producers create containers of a fixed size,
+ * and each session combines as many of them into a single work item as are needed for its
+ * client to take about a target time per item: Fast clients get large items, so round trips
+ * do not dominate, while slow clients get small ones, so no stragglers hold up the end of a
+ * run. Clients report the time they spent processing each item along with the result.
+ */
+
+// Standard headers go here
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+// Boost headers go here
+// Nothing
+
+// Our own headers go here
+// Nothing
+
+/******************************************************************************************/
+
+/** @brief The settings of the adaptive work granularity */
+struct granularity_settings {
+    double target_time = 0.; ///< The desired processing time per work item in seconds. 0 disables batching
+    std::size_t max_units = 64; ///< The largest number of containers combined into one work item
+    std::size_t unit_size = 0; ///< The number of values per container, used to interpret speeds announced by clients
+};
+
+/******************************************************************************************/
+////////////////////////////////////////////////////////////////////////////////////////////
+/******************************************************************************************/
+/**
+ * Determines the number of containers per work item from the processing times reported by a
+ * client. Each session holds its own instance, so no synchronization is needed.
+ */
+class granularity_controller {
+public:
+    explicit granularity_controller(const granularity_settings &settings)
+        : m_settings(settings) { /* nothing */ }
+
+    [[nodiscard]] bool enabled() const noexcept {
+        return m_settings.target_time > 0.;
+    }
+
+    /** @brief Takes note of the time a client needed for a work item made up of n_units containers */
+    void update(std::size_t n_units, double processing_time) {
+        if (!enabled() || 0 == n_units || processing_time <= 0.) return;
+
+        // Smooth out the noise of individual measurements
+        auto time_per_unit = processing_time / double(n_units);
+        m_time_per_unit = (0 == m_n_updates) ? time_per_unit : (1. - SMOOTHING) * m_time_per_unit + SMOOTHING * time_per_unit;
+        m_n_updates++;
+        adjust();
+    }
+
+    /** @brief Starts from the speed (values per second) a client announced, until the first result arrives */
+    void seed(double speed) {
+        if (!enabled() || 0 != m_n_updates || speed <= 0. || 0 == m_settings.unit_size) return;
+
+        m_time_per_unit = double(m_settings.unit_size) / speed;
+        adjust();
+    }
+
+    /** @brief The number of containers the next work item should be made of */
+    [[nodiscard]] std::size_t get_n_units() const noexcept {
+        return m_n_units;
+    }
+
+    /** @brief The smoothed processing time per container in seconds. 0 before the first update */
+    [[nodiscard]] double get_time_per_unit() const noexcept {
+        return m_time_per_unit;
+    }
+
+private:
+    void adjust() {
+        auto n_target_units = std::llround(m_settings.target_time / m_time_per_unit);
+        m_n_units = static_cast<std::size_t>(std::clamp<long long>(n_target_units, 1, static_cast<long long>(m_settings.max_units)));
+    }
+
+    static constexpr double SMOOTHING = 0.25; ///< The weight of the latest measurement
+
+    granularity_settings m_settings;
+    std::size_t m_n_units = 1; ///< Start small until we know the client
+    double m_time_per_unit = 0.;
+    std::size_t m_n_updates = 0;
+};
+
+/******************************************************************************************/
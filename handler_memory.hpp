@@ -0,0 +1,232 @@
+/**
+ * @file handler_memory.hpp
+ */
+
+/*
+ * The following license applies to the code in this file:
+ *
+ * **************************************************************************
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * **************************************************************************
+ *
+ * Author: Dr. Rüdiger Berlich of Gemfony scientific UG (haftungsbeschraenkt)
+ * See http://www.gemfony.eu for further information.
+ *
+ * This code is based on the Beast Websocket library by Vinnie Falco.
+ */
+
+#pragma once
+
+/******************************************************************************************/
+/*
+ * Recycled memory for completion handlers. Each asynchronous read or write has Asio (and
+ * Beast) allocate the state of the operation, including the handler, through the handler's
+ * associated allocator -- by default with operator new. Sessions and clients start the same
+ * few operations over and over, so they keep a handful of fixed-size blocks and hand them out
+ * again once an operation has finished. In the steady state, no memory is allocated for
+ * handlers. Requests too large for a block, or arriving while all blocks are in use, go to
+ * the heap.
+ */
+
+// Standard headers go here
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Boost headers go here
+#include <boost/asio/associated_executor.hpp>
+
+// Our own headers go here
+// Nothing
+
+/******************************************************************************************/
+////////////////////////////////////////////////////////////////////////////////////////////
+/******************************************************************************************/
+/**
+ * A fixed number of memory blocks for the operations of one session or client. Operations may
+ * finish (and give back their memory) on another thread than the one starting new operations,
+ * so the blocks are claimed through atomic flags.
+ */
+class handler_memory {
+public:
+    static constexpr std::size_t NBLOCKS = 8;
+    static constexpr std::size_t BLOCKSIZE = 2048;
+
+    handler_memory() = default;
+    handler_memory(const handler_memory &) = delete;
+    handler_memory &operator=(const handler_memory &) = delete;
+
+    void *allocate(std::size_t size, std::size_t alignment) {
+        if (size <= BLOCKSIZE && alignment <= alignof(block_type)) {
+            for (std::size_t i = 0; i < NBLOCKS; i++) {
+                bool expected = false;
+                if (!m_in_use[i].load(std::memory_order_relaxed)
+                    && m_in_use[i].compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                    m_n_recycled.fetch_add(1, std::memory_order_relaxed);
+                    return &m_blocks[i];
+                }
+            }
+        }
+
+        m_n_heap.fetch_add(1, std::memory_order_relaxed);
+        return ::operator new(size);
+    }
+
+    void deallocate(void *pointer) {
+        auto *block = static_cast<block_type *>(pointer);
+        std::less<const block_type *> before;
+        if (!before(block, m_blocks) && before(block, m_blocks + NBLOCKS)) {
+            m_in_use[block - m_blocks].store(false, std::memory_order_release);
+        } else {
+            ::operator delete(pointer);
+        }
+    }
+
+    /** @brief The number of allocations served from the blocks */
+    [[nodiscard]] std::size_t get_n_recycled() const {
+        return m_n_recycled.load(std::memory_order_relaxed);
+    }
+
+    /** @brief The number of allocations that had to go to the heap */
+    [[nodiscard]] std::size_t get_n_heap() const {
+        return m_n_heap.load(std::memory_order_relaxed);
+    }
+
+private:
+    using block_type = std::aligned_storage_t<BLOCKSIZE, alignof(std::max_align_t)>;
+
+    block_type m_blocks[NBLOCKS];
+    std::atomic<bool> m_in_use[NBLOCKS]{};
+
+    std::atomic<std::size_t> m_n_recycled{0};
+    std::atomic<std::size_t> m_n_heap{0};
+};
+
+/******************************************************************************************/
+/**
+ * The allocator associated with handlers bound to a handler_memory object
+ */
+template<typename T>
+class handler_memory_allocator {
+    template<typename> friend class handler_memory_allocator;
+
+public:
+    using value_type = T;
+
+    explicit handler_memory_allocator(handler_memory &memory) noexcept
+        : m_memory(&memory)
+    { /* nothing */ }
+
+    template<typename U>
+    handler_memory_allocator(const handler_memory_allocator<U> &other) noexcept // NOLINT
+        : m_memory(other.m_memory)
+    { /* nothing */ }
+
+    T *allocate(std::size_t n) {
+        return static_cast<T *>(m_memory->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *pointer, std::size_t /* n */) {
+        m_memory->deallocate(pointer);
+    }
+
+    template<typename U>
+    bool operator==(const handler_memory_allocator<U> &other) const noexcept {
+        return m_memory == other.m_memory;
+    }
+
+    template<typename U>
+    bool operator!=(const handler_memory_allocator<U> &other) const noexcept {
+        return m_memory != other.m_memory;
+    }
+
+private:
+    handler_memory *m_memory;
+};
+
+/******************************************************************************************/
+/**
+ * Wraps a completion handler, so the memory of its operation is taken from a handler_memory
+ * object. The handler_memory object needs to outlive the operation, which is the case when
+ * it belongs to the object the handler keeps alive (through shared_from_this()).
+ */
+template<typename handler_t>
+class memory_bound_handler {
+public:
+    using allocator_type = handler_memory_allocator<void>;
+
+    memory_bound_handler(handler_memory &memory, handler_t &&handler)
+        : m_memory(memory)
+        , m_handler(std::move(handler))
+    { /* nothing */ }
+
+    [[nodiscard]] allocator_type get_allocator() const noexcept {
+        return allocator_type(m_memory);
+    }
+
+    template<typename... args_t>
+    void operator()(args_t &&... args) {
+        m_handler(std::forward<args_t>(args)...);
+    }
+
+    const handler_t &get_handler() const noexcept {
+        return m_handler;
+    }
+
+private:
+    handler_memory &m_memory;
+    handler_t m_handler;
+};
+
+/** @brief Binds a completion handler to a handler_memory object */
+template<typename handler_t>
+memory_bound_handler<std::decay_t<handler_t>> bind_handler_memory(handler_memory &memory, handler_t &&handler) {
+    return memory_bound_handler<std::decay_t<handler_t>>(memory, std::forward<handler_t>(handler));
+}
+
+/******************************************************************************************/
+
+// Wrapped handlers keep the executor of the original handler (if any)
+namespace boost {
+namespace asio {
+
+template<typename handler_t, typename executor_t>
+struct associated_executor<memory_bound_handler<handler_t>, executor_t> {
+    using type = typename associated_executor<handler_t, executor_t>::type;
+
+    static type get(const memory_bound_handler<handler_t> &handler, const executor_t &executor = executor_t()) noexcept {
+        return associated_executor<handler_t, executor_t>::get(handler.get_handler(), executor);
+    }
+};
+
+} /* namespace asio */
+} /* namespace boost */
+
+/******************************************************************************************/
@@ -0,0 +1,336 @@
+/**
+ * @file inflight.hpp
+ */
+
+/*
+ * The following license applies to the code in this file:
+ *
+ * **************************************************************************
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * **************************************************************************
+ *
+ * Author: Dr. Rüdiger Berlich of Gemfony scientific UG (haftungsbeschraenkt)
+ * See http://www.gemfony.eu for further information.
+ *
+ * This code is based on the Beast Websocket library by Vinnie Falco.
+ */
+
+#pragma once
+
+/******************************************************************************************/
+/*
+ * Tracking of work items that have been sent to clients but whose results have not yet
+ * arrived. Each item is kept (in serialized form) until its first result arrives, so it can
+ * be sent again if
+ * - the session holding it goes away (e.g. because its client died),
+ * - its client does not answer within a timeout, or
+ * - speculative execution is enabled and clients run out of new work: the oldest outstanding
+ *   items are then duplicated to idle clients, so slow clients do not determine the end of a run.
+ * Whichever result arrives first is accepted, later ones are ignored. Clients that reconnect
+ * identify themselves with a resume token and may still deliver the result of the item held
+ * by their old session.
+ *
+ * With --pipeline_depth, a session holds many items at once, so the number of tracked items
+ * may be far larger than the number of clients. Timeouts are therefore found through an index
+ * ordered by deadline, which only needs to be looked at up to the first item not yet due.
+ */
+
+// Standard headers go here
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+
+// Boost headers go here
+// Nothing
+
+// Our own headers go here
+// Nothing
+
+/******************************************************************************************/
+
+/** @brief The settings of the tracking of in-flight work items */
+struct tracking_settings {
+    bool enabled = false; ///< Whether in-flight items are tracked at all
+    double timeout = 0.; ///< Items are sent again if no result arrived after this many seconds. 0 means "never"
+    bool speculative = false; ///< Whether outstanding items are duplicated to clients without new work
+    std::size_t max_copies = 2; ///< The largest number of clients working on the same item at once
+    double resume_window = 60.; ///< Clients that went away may resume their item within this many seconds
+};
+
+/** @brief A work item to be sent (again) */
+struct tracked_item {
+    std::uint64_t id = 0;
+    std::string message; ///< The serialized (uncompressed) work item
+    std::size_t n_units = 1; ///< The number of containers making up the item
+    std::uint64_t job_id = 0; ///< The broker job the item belongs to, if any
+};
+
+/** @brief A work item held by a client, as seen by its session */
+struct item_in_flight {
+    std::uint64_t id = 0; ///< The id of the tracked item. 0 if the item is not tracked
+    std::size_t n_units = 1; ///< The number of containers making up the item
+    std::uint64_t job_id = 0; ///< The broker job the item belongs to, if any
+};
+
+/******************************************************************************************/
+////////////////////////////////////////////////////////////////////////////////////////////
+/******************************************************************************************/
+/**
+ * Keeps track of in-flight work items. Thread-safe.
+ */
+class inflight_tracker {
+public:
+    explicit inflight_tracker(const tracking_settings &settings)
+        : m_settings(settings) { /* nothing */ }
+
+    inflight_tracker(const inflight_tracker &) = delete;
+    inflight_tracker &operator=(const inflight_tracker &) = delete;
+
+    /** @brief Registers a new item about to be sent. Returns its id */
+    std::uint64_t dispatch(const char *data, std::size_t size, std::size_t n_units, std::uint64_t job_id = 0) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto id = ++m_last_id;
+        auto &entry = m_items[id];
+        entry.message.assign(data, size);
+        entry.n_units = n_units;
+        entry.job_id = job_id;
+        entry.deadline_it = m_deadlines.end();
+        set_deadline(id, entry, std::chrono::steady_clock::now());
+        return id;
+    }
+
+    /**
+     * Finds an item to be sent again: items of sessions that went away come first, then items
+     * that timed out and -- if no new work is left and speculative execution is enabled -- the
+     * oldest outstanding item. Returns false if there is nothing to be sent again.
+     */
+    bool redispatch(tracked_item &item, bool out_of_work) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto now = std::chrono::steady_clock::now();
+
+        while (!m_retry_ids.empty()) {
+            auto id = m_retry_ids.front();
+            m_retry_ids.pop_front();
+
+            // The result may have arrived in the meantime, or the item may have been sent again after a timeout
+            auto it = m_items.find(id);
+            if (it == m_items.end() || it->second.n_holders > 0) continue;
+
+            m_n_requeued++;
+            return take(it, item, now);
+        }
+
+        // Due items already held by max_copies sessions are skipped. There are at most as many
+        // of them as there are sessions.
+        for (auto deadline_it = m_deadlines.begin(); deadline_it != m_deadlines.end() && deadline_it->first < now; ++deadline_it) {
+            auto it = m_items.find(deadline_it->second);
+            if (it->second.n_holders < m_settings.max_copies) {
+                m_n_timed_out++;
+                return take(it, item, now);
+            }
+        }
+
+        if (out_of_work && m_settings.speculative) {
+            // Ids grow with time, so the first item with room for another copy is the oldest one
+            for (auto it = m_items.begin(); it != m_items.end(); ++it) {
+                if (it->second.n_holders < m_settings.max_copies) {
+                    m_n_speculative++;
+                    return take(it, item, now);
+                }
+            }
+        }
+
+        return false;
+    }
+
+    /** @brief Registers a result. Returns true if it is the first one for this item */
+    bool complete(std::uint64_t id) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_items.find(id);
+        if (it == m_items.end()) {
+            m_n_late_results++;
+            return false;
+        }
+
+        if (m_settings.timeout > 0.) m_deadlines.erase(it->second.deadline_it);
+        m_items.erase(it);
+        return true;
+    }
+
+    /** @brief Called when a session holding the item goes away without a result */
+    void release(std::uint64_t id, std::uint64_t resume_token = 0) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_items.find(id);
+        if (it == m_items.end()) return;
+
+        // The client may come back with the result
+        auto now = std::chrono::steady_clock::now();
+        expire_resumable(now);
+        if (0 != resume_token) {
+            m_resumable[resume_token] = resumable{id, now};
+            m_resumable_order.emplace_back(now, resume_token);
+        }
+
+        // Other sessions may still deliver the result
+        if (it->second.n_holders > 0) it->second.n_holders--;
+        if (0 == it->second.n_holders) m_retry_ids.push_back(id);
+    }
+
+    /**
+     * Re-associates a reconnecting client with the item held by its old session. Returns the
+     * item, whose id is 0 if there is none or its result has arrived in the meantime.
+     */
+    item_in_flight resume(std::uint64_t resume_token) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        expire_resumable(std::chrono::steady_clock::now());
+        auto resumable_it = m_resumable.find(resume_token);
+        if (resumable_it == m_resumable.end()) return item_in_flight{};
+
+        auto id = resumable_it->second.id;
+        m_resumable.erase(resumable_it);
+
+        auto it = m_items.find(id);
+        if (it == m_items.end()) return item_in_flight{};
+
+        it->second.n_holders++;
+        m_n_resumed++;
+        return item_in_flight{id, it->second.n_units, it->second.job_id};
+    }
+
+    /** @brief Registers a result no item is known for, e.g. one re-sent by a client that could not be resumed */
+    void discard_result() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_n_late_results++;
+    }
+
+    /** @brief The number of items whose results are still outstanding */
+    std::size_t get_n_in_flight() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_items.size();
+    }
+
+    /** @brief The number of items sent again because their session went away */
+    std::size_t get_n_requeued() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_n_requeued;
+    }
+
+    /** @brief The number of items sent again because of a timeout */
+    std::size_t get_n_timed_out() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_n_timed_out;
+    }
+
+    /** @brief The number of items re-associated with reconnecting clients */
+    std::size_t get_n_resumed() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_n_resumed;
+    }
+
+    /** @brief The number of speculative copies sent */
+    std::size_t get_n_speculative() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_n_speculative;
+    }
+
+    /** @brief The number of results that arrived after another result for the same item, or for no known item */
+    std::size_t get_n_late_results() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_n_late_results;
+    }
+
+private:
+    using deadline_index = std::multimap<std::chrono::steady_clock::time_point, std::uint64_t>;
+
+    struct entry {
+        std::string message;
+        std::size_t n_units = 1;
+        std::uint64_t job_id = 0;
+        std::size_t n_holders = 1; ///< The number of sessions currently working on the item
+        deadline_index::iterator deadline_it; ///< The item's entry in m_deadlines, if there is a timeout
+    };
+
+    struct resumable {
+        std::uint64_t id = 0;
+        std::chrono::steady_clock::time_point released;
+    };
+
+    // Forgets clients that did not come back in time. Needs to be called with the lock held
+    void expire_resumable(std::chrono::steady_clock::time_point now) {
+        auto window = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(m_settings.resume_window));
+        while (!m_resumable_order.empty() && m_resumable_order.front().first + window < now) {
+            // The client may have gone away again since, in which case a newer entry is kept
+            auto it = m_resumable.find(m_resumable_order.front().second);
+            if (it != m_resumable.end() && it->second.released == m_resumable_order.front().first) m_resumable.erase(it);
+            m_resumable_order.pop_front();
+        }
+    }
+
+    // (Re-)starts the timeout of an item. Needs to be called with the lock held
+    void set_deadline(std::uint64_t id, entry &e, std::chrono::steady_clock::time_point now) {
+        if (m_settings.timeout <= 0.) return;
+
+        auto deadline = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(m_settings.timeout));
+        if (e.deadline_it != m_deadlines.end()) m_deadlines.erase(e.deadline_it);
+        e.deadline_it = m_deadlines.emplace(deadline, id);
+    }
+
+    // Hands out another copy of an item. Needs to be called with the lock held
+    bool take(std::map<std::uint64_t, entry>::iterator it, tracked_item &item, std::chrono::steady_clock::time_point now) {
+        it->second.n_holders++;
+        set_deadline(it->first, it->second, now);
+
+        item.id = it->first;
+        item.message = it->second.message;
+        item.n_units = it->second.n_units;
+        item.job_id = it->second.job_id;
+        return true;
+    }
+
+    tracking_settings m_settings;
+
+    mutable std::mutex m_mutex;
+    std::map<std::uint64_t, entry> m_items; ///< Ordered by id, i.e. by the time of the first dispatch
+    deadline_index m_deadlines; ///< Ids of items by the time they are to be sent again. Only used with a timeout
+    std::deque<std::uint64_t> m_retry_ids; ///< Items no session is working on any more
+    std::map<std::uint64_t, resumable> m_resumable; ///< Resume tokens of clients that went away and their items
+    std::deque<std::pair<std::chrono::steady_clock::time_point, std::uint64_t>> m_resumable_order; ///< Resume tokens in the order their clients went away
+    std::uint64_t m_last_id = 0;
+
+    std::size_t m_n_requeued = 0;
+    std::size_t m_n_timed_out = 0;
+    std::size_t m_n_resumed = 0;
+    std::size_t m_n_speculative = 0;
+    std::size_t m_n_late_results = 0;
+};
+
+/******************************************************************************************/
@@ -50,17 +50,51 @@
 
 // Application headers go here
 #include "async_websocket_server.hpp"
+#include "submitter.hpp"
 
 namespace po = boost::program_options;
 
 const payload_type   DEFAULTPAYLOADTYPE = payload_type::container;
 const double         DEFAULTSLEEPTIME = 1.;
 const std::size_t    DEFAULTCONTAINERSIZE = 1000;
+const random_generator DEFAULTRANDOMGENERATOR = random_generator::mt19937;
+const std::uint64_t  DEFAULTSEED = 0;
 const std::size_t    DEFAULTNACCEPT = 10000;
 const unsigned short DEFAULTPORT = 10000;
 const std::size_t    DEFAULTFULLQUEUESLEEPMS = 5;
 const std::size_t    DEFAULTMAXQUEUESIZE = 5000;
 const std::string    DEFAULTHOST = "127.0.0.1"; // localhost // NOLINT
+const double         DEFAULTWARMUPTIME = 0.;
+const double         DEFAULTCOOLDOWNTIME = 0.;
+const std::size_t    DEFAULTSAMPLEINTERVALMS = 1000;
+const double         DEFAULTMAXDURATION = 0.;
+const std::size_t    DEFAULTECHOSIZE = 0;
+const transport_type DEFAULTTRANSPORT = transport_type::websocket;
+const std::string    DEFAULTSOCKETPATH = "/tmp/estray.sock"; // NOLINT
+const std::size_t    DEFAULTSHMRINGSIZEMB = 64;
+const compression_codec  DEFAULTCOMPRESSIONCODEC = compression_codec::none;
+const compression_filter DEFAULTCOMPRESSIONFILTER = compression_filter::none;
+const std::size_t    DEFAULTCOMPRESSIONTHRESHOLD = 1024;
+const int            DEFAULTCOMPRESSIONLEVEL = 0;
+const std::size_t    DEFAULTRESULTBATCHKB = 4096;
+const std::size_t    DEFAULTRESULTMAXPENDINGMB = 256;
+const std::size_t    DEFAULTNMERGETHREADS = 0;
+const double         DEFAULTTARGETITEMMS = 0.;
+const std::size_t    DEFAULTMAXBATCH = 64;
+const double         DEFAULTITEMTIMEOUT = 0.;
+const std::size_t    DEFAULTMAXCOPIES = 2;
+const std::size_t    DEFAULTRECONNECTATTEMPTS = 0;
+const std::size_t    DEFAULTRECONNECTDELAYMS = 100;
+const std::size_t    DEFAULTMAXRECONNECTDELAYMS = 10000;
+const double         DEFAULTSLOWCLIENTFRACTION = 0.5;
+const double         DEFAULTDRAINTIMEOUT = 10.;
+const std::size_t    DEFAULTPIPELINEDEPTH = 1;
+const std::size_t    DEFAULTBUFFERCACHEMB = 256;
+const std::size_t    DEFAULTSPILLMAXMB = 4096;
+const std::size_t    DEFAULTSPILLSEGMENTMB = 64;
+const std::size_t    DEFAULTBROKERPENDINGMB = 1024;
+const std::size_t    DEFAULTNSUBMIT = 1000;
+const std::size_t    DEFAULTSUBMITBATCH = 100;
 
 /******************************************************************************************/
 
@@ -69,6 +103,12 @@ int main(int argc, char **argv) {
 	payload_type   pType = DEFAULTPAYLOADTYPE;
 	double         payload_sleep_time = DEFAULTSLEEPTIME;
 	std::size_t    container_size = DEFAULTCONTAINERSIZE;
+	random_generator generator = DEFAULTRANDOMGENERATOR;
+	std::uint64_t  seed = DEFAULTSEED;
+	std::string    record_path;
+	std::string    replay_path;
+	std::string    spool_path;
+	std::string    create_spool_path;
 	std::size_t    max_n_served = DEFAULTNACCEPT;
 	std::size_t    n_producer_threads = 0;
 	std::size_t    n_context_threads = 0;
@@ -77,6 +117,38 @@ int main(int argc, char **argv) {
 	unsigned short port = DEFAULTPORT;
 	std::string    host = DEFAULTHOST;
 	std::size_t    client_id = 0;
+	double         warm_up_time = DEFAULTWARMUPTIME;
+	double         cool_down_time = DEFAULTCOOLDOWNTIME;
+	std::size_t    sample_interval_ms = DEFAULTSAMPLEINTERVALMS;
+	double         max_duration = DEFAULTMAXDURATION;
+	std::size_t    echo_size = DEFAULTECHOSIZE;
+	transport_type transport = DEFAULTTRANSPORT;
+	std::string    socket_path = DEFAULTSOCKETPATH;
+	std::size_t    shm_ring_size_mb = DEFAULTSHMRINGSIZEMB;
+	bool           flat_containers = false;
+	compression_settings compression;
+	bool           permessage_deflate = false;
+	std::string    result_path;
+	std::size_t    result_batch_kb = DEFAULTRESULTBATCHKB;
+	std::size_t    result_max_pending_mb = DEFAULTRESULTMAXPENDINGMB;
+	sort_settings  sort;
+	double         target_item_ms = DEFAULTTARGETITEMMS;
+	granularity_settings granularity;
+	tracking_settings tracking;
+	reconnect_settings reconnect;
+	double         slow_client_fraction = DEFAULTSLOWCLIENTFRACTION;
+	double         drain_timeout = DEFAULTDRAINTIMEOUT;
+	std::size_t    pipeline_depth = DEFAULTPIPELINEDEPTH;
+	std::size_t    buffer_cache_mb = DEFAULTBUFFERCACHEMB;
+	affinity_settings affinity;
+	std::string    client_cores;
+	std::string    spill_dir;
+	std::size_t    spill_max_mb = DEFAULTSPILLMAXMB;
+	std::size_t    spill_segment_mb = DEFAULTSPILLSEGMENTMB;
+	broker_settings broker;
+	std::size_t    broker_pending_mb = DEFAULTBROKERPENDINGMB;
+	bool           is_submitter = false;
+	submission_settings submission;
 
 	try {
 		po::options_description desc("Available options");
@@ -90,6 +162,18 @@ int main(int argc, char **argv) {
 			(
 				"container_size,s", po::value<std::size_t>(&container_size)->default_value(DEFAULTCONTAINERSIZE)
 				, "The desired size of each container_payload object")
+			(  "rng", po::value<random_generator>(&generator)->default_value(DEFAULTRANDOMGENERATOR)
+			   , R"(The generator used for the numbers of container_payload objects. 0: "mt19937" (one std::normal_distribution call per number), 1: "xoshiro" (xoshiro256++ with a block-wise Box-Muller transform, fills whole containers in one pass))")
+			(  "seed", po::value<std::uint64_t>(&seed)->default_value(DEFAULTSEED)
+			   , "The seed of the payload producers. Each producer derives its own, reproducible stream from it. 0 seeds from std::random_device")
+			(  "record", po::value<std::string>(&record_path)->default_value("")
+			   , "Write every payload produced by the server to this workload file")
+			(  "replay", po::value<std::string>(&replay_path)->default_value("")
+			   , "Feed the server from this workload file (created with --record) instead of the producers. The file is replayed repeatedly if needed")
+			(  "spool", po::value<std::string>(&spool_path)->default_value("")
+			   , "Serve pre-serialized work items from this spool file (created with --create_spool) instead of the payload queue. The file is served repeatedly if needed")
+			(  "create_spool", po::value<std::string>(&create_spool_path)->default_value("")
+			   , "Write max_n_served work items to this spool file and exit. Payload settings, --flat_containers and the compression settings are applied when the spool is created")
 			(  "payload_sleep_time,t", po::value<double>(&payload_sleep_time)->default_value(DEFAULTSLEEPTIME),
 			   "The amount of time in seconds that each client with a sleep_payload should sleep")
 			(
@@ -100,7 +184,15 @@ int main(int argc, char **argv) {
 				, R"(The number of threads used for the io_context. 0 uses "hardware_concurrency".)")
 			(
 				"max_n_served,m", po::value<std::size_t>(&max_n_served)->default_value(DEFAULTNACCEPT)
-				, "The total number of packages served by the server")
+				, "The total number of packages served by the server. 0 means \"no limit\" (requires max_duration)")
+			(  "max_duration", po::value<double>(&max_duration)->default_value(DEFAULTMAXDURATION)
+			   , "The maximum duration of a server run in seconds. 0 means \"no limit\"")
+			(  "warm_up_time", po::value<double>(&warm_up_time)->default_value(DEFAULTWARMUPTIME)
+			   , "The time in seconds at the start of a run excluded from the steady-state throughput statistics")
+			(  "cool_down_time", po::value<double>(&cool_down_time)->default_value(DEFAULTCOOLDOWNTIME)
+			   , "The time in seconds at the end of a run excluded from the steady-state throughput statistics")
+			(  "sample_interval_ms", po::value<std::size_t>(&sample_interval_ms)->default_value(DEFAULTSAMPLEINTERVALMS)
+			   , "The length in milliseconds of each window used for throughput measurements")
 			(  "full_queue_sleep_ms,f", po::value<std::size_t>(&full_queue_sleep_ms)->default_value(DEFAULTFULLQUEUESLEEPMS)
 			   , "The amount of milliseconds a payload producer should pause when the queue is full")
 			(  "max_queue_size,q", po::value<std::size_t>(&max_queue_size)->default_value(DEFAULTMAXQUEUESIZE)
@@ -109,9 +201,93 @@ int main(int argc, char **argv) {
 				, "The port to which a client should connect or on which the server should listen")
 			(  "host", po::value<std::string>(&host)->default_value(DEFAULTHOST)
 				, "IP or name of the host running the server")
+			(  "transport", po::value<transport_type>(&transport)->default_value(DEFAULTTRANSPORT)
+			   , R"(The transport used between server and clients. 0: "websocket", 1: "tcp" (length-prefixed messages without websocket framing), 2: "unix" (like 1, but through a unix domain socket), 3: "shm" (shared-memory rings, descriptors are passed through a unix domain socket). 2 and 3 are for clients on the server machine. Needs to be set on server and client)")
+			(  "socket_path", po::value<std::string>(&socket_path)->default_value(DEFAULTSOCKETPATH)
+			   , "The path of the unix domain socket used by the local transports")
+			(  "shm_ring_size", po::value<std::size_t>(&shm_ring_size_mb)->default_value(DEFAULTSHMRINGSIZEMB)
+			   , "The size in MiB of each of the two ring buffers per session of the shared-memory transport. Larger messages are sent through the socket")
             (  "client_id" , po::value<std::size_t>(&client_id)->default_value(0)
                 , "A unique id to be assigned to the client to make it distinguishable in the output"
             )
+			(  "echo_size", po::value<std::size_t>(&echo_size)->default_value(DEFAULTECHOSIZE)
+			   , "Transport-only mode: Exchange pre-built messages of this size in bytes without (de-)serialization or processing. 0 disables this mode. Needs to be set on server and client")
+			(  "flat_containers", po::value<bool>(&flat_containers)->default_value(false)->implicit_value(true)
+			   , "Send container payloads in a flat format that clients sort inside their receive buffer, instead of through Boost.Serialization. Only needs to be set on the server")
+			(  "compression_codec", po::value<compression_codec>(&compression.codec)->default_value(DEFAULTCOMPRESSIONCODEC)
+			   , R"(Compression of messages. 0: "none", 1: "zlib", 2: "lz4", 3: "zstd" (2 and 3 need to be enabled in CMakeLists.txt). Only needs to be set on the server, clients answer in the same way)")
+			(  "compression_filter", po::value<compression_filter>(&compression.filter)->default_value(DEFAULTCOMPRESSIONFILTER)
+			   , R"(Transformation of messages before compression. 0: "none", 1: "shuffle" (groups the n-th bytes of all 8-byte words), 2: "xor_delta" (XOR of each 8-byte word with its predecessor), 3: "xor_shuffle" (both))")
+			(  "compression_threshold", po::value<std::size_t>(&compression.threshold)->default_value(DEFAULTCOMPRESSIONTHRESHOLD)
+			   , "Messages smaller than this number of bytes are sent uncompressed")
+			(  "compression_level", po::value<int>(&compression.level)->default_value(DEFAULTCOMPRESSIONLEVEL)
+			   , "The compression level for zlib and zstd. 0 uses the default level of the codec")
+			(  "permessage_deflate", po::value<bool>(&permessage_deflate)->default_value(false)->implicit_value(true)
+			   , "Enable the permessage-deflate extension of the websocket transport. Needs to be set on server and client")
+			(  "results", po::value<std::string>(&result_path)->default_value("")
+			   , "Append all verified results to this file. Results are written in batches by a separate thread")
+			(  "result_batch_size", po::value<std::size_t>(&result_batch_kb)->default_value(DEFAULTRESULTBATCHKB)
+			   , "The size in KiB of the batches of results written to disk")
+			(  "result_max_pending", po::value<std::size_t>(&result_max_pending_mb)->default_value(DEFAULTRESULTMAXPENDINGMB)
+			   , "The amount of memory in MiB results may occupy while waiting for the disk. Further results are dropped")
+			(  "sort_output", po::value<std::string>(&sort.output_path)->default_value("")
+			   , "Act as a distributed sort: Split the input into containers of container_size values, have them sorted by the clients and merge the sorted runs into this file (doubles in native byte order). The runs are stored in the --results file (default: <sort_output>.runs)")
+			(  "sort_input", po::value<std::string>(&sort.input_path)->default_value("")
+			   , "The input of the distributed sort: A file of doubles in native byte order. max_n_served containers of random numbers are sorted if this is not set")
+			(  "merge_threads", po::value<std::size_t>(&sort.n_merge_threads)->default_value(DEFAULTNMERGETHREADS)
+			   , "The number of threads merging the sorted runs. 0 uses \"hardware_concurrency\"")
+			(  "target_item_ms", po::value<double>(&target_item_ms)->default_value(DEFAULTTARGETITEMMS)
+			   , "Adaptive work granularity: Combine as many containers into one work item as a client needs to spend about this many milliseconds on it, as measured from its earlier results. 0 disables this")
+			(  "max_batch", po::value<std::size_t>(&granularity.max_units)->default_value(DEFAULTMAXBATCH)
+			   , "The largest number of containers combined into one work item by the adaptive work granularity")
+			(  "track_items", po::value<bool>(&tracking.enabled)->default_value(false)->implicit_value(true)
+			   , "Keep work items until their results arrive, and send them to another client if their session goes away")
+			(  "item_timeout", po::value<double>(&tracking.timeout)->default_value(DEFAULTITEMTIMEOUT)
+			   , "Send tracked work items to another client if no result arrived after this many seconds. 0 means \"never\". Implies --track_items")
+			(  "speculative", po::value<bool>(&tracking.speculative)->default_value(false)->implicit_value(true)
+			   , "Send copies of the oldest outstanding work items to clients for which there is no new work. The first result is accepted. Implies --track_items")
+			(  "max_copies", po::value<std::size_t>(&tracking.max_copies)->default_value(DEFAULTMAXCOPIES)
+			   , "The largest number of clients working on the same tracked work item at once")
+			(  "reconnect_attempts", po::value<std::size_t>(&reconnect.max_attempts)->default_value(DEFAULTRECONNECTATTEMPTS)
+			   , "Clients only: The number of consecutive attempts to re-establish a lost connection before giving up. 0 disables reconnects")
+			(  "reconnect_delay_ms", po::value<std::size_t>(&reconnect.initial_delay_ms)->default_value(DEFAULTRECONNECTDELAYMS)
+			   , "Clients only: The upper limit of the random delay before the first reconnect attempt. It doubles with each further attempt")
+			(  "max_reconnect_delay_ms", po::value<std::size_t>(&reconnect.max_delay_ms)->default_value(DEFAULTMAXRECONNECTDELAYMS)
+			   , "Clients only: The largest delay between reconnect attempts")
+			(  "slow_client_fraction", po::value<double>(&slow_client_fraction)->default_value(DEFAULTSLOWCLIENTFRACTION)
+			   , "Clients processing containers slower than this fraction of the median speed receive no new work at the end of a run. 0 disables this")
+			(  "drain_timeout", po::value<double>(&drain_timeout)->default_value(DEFAULTDRAINTIMEOUT)
+			   , "The time in seconds the server waits for outstanding results once a stop criterion was reached. Clients still busy then are asked to leave")
+			(  "pipeline_depth", po::value<std::size_t>(&pipeline_depth)->default_value(DEFAULTPIPELINEDEPTH)
+			   , "Clients only: The number of work items a client holds at once. Latency-bound payloads (sleep_payload) are then processed concurrently")
+			(  "buffer_cache", po::value<std::size_t>(&buffer_cache_mb)->default_value(DEFAULTBUFFERCACHEMB)
+			   , "The amount of memory in MiB kept for the reuse of message buffers. Sessions return their buffers between messages")
+			(  "io_cores", po::value<std::string>(&affinity.io_cores)
+			   , R"(Pin the io threads of the server to these cores, one core per thread in list order, e.g. "0-3,8")")
+			(  "producer_cores", po::value<std::string>(&affinity.producer_cores)
+			   , "Pin the producer threads of the server to these cores, one core per thread in list order")
+			(  "client_cores", po::value<std::string>(&client_cores)
+			   , "Clients only: Pin the io thread of a client to the first and its processing thread to the second of these cores")
+			(  "numa", po::value<bool>(&affinity.numa)->default_value(false)->implicit_value(true)
+			   , "Spread threads without a core list over the NUMA nodes: io and producer threads round-robin, the threads of a client on the node of its client_id")
+			(  "spill_dir", po::value<std::string>(&spill_dir)
+			   , "Producers append payloads that do not fit into the queue to segment files in this directory instead of waiting. They are read back as soon as the queue has room")
+			(  "spill_max_mb", po::value<std::size_t>(&spill_max_mb)->default_value(DEFAULTSPILLMAXMB)
+			   , "The largest amount of spilled payloads in MiB kept on disk. Producers wait once it is reached")
+			(  "spill_segment_mb", po::value<std::size_t>(&spill_segment_mb)->default_value(DEFAULTSPILLSEGMENTMB)
+			   , "The size in MiB of the segment files holding spilled payloads. Segments are removed once they have been read back")
+			(  "broker", po::value<bool>(&broker.enabled)->default_value(false)->implicit_value(true)
+			   , "Act as a broker: Payloads are submitted by external processes (see --submit) instead of being produced by the server. Implies --track_items. Without max_n_served and max_duration, the broker runs until it is stopped with SIGINT or SIGTERM")
+			(  "broker_pending_mb", po::value<std::size_t>(&broker_pending_mb)->default_value(DEFAULTBROKERPENDINGMB)
+			   , "The largest amount of results in MiB the broker keeps for submitters. No further payloads are accepted until results have been collected")
+			(  "submit", po::value<bool>(&is_submitter)->default_value(false)->implicit_value(true)
+			   , "Act as a submitter: Hand a job of payloads (following the payload settings) to a broker over a websocket and collect its results")
+			(  "n_submit", po::value<std::size_t>(&submission.n_payloads)->default_value(DEFAULTNSUBMIT)
+			   , "Submitters only: The number of payloads in the job")
+			(  "submit_batch", po::value<std::size_t>(&submission.batch_size)->default_value(DEFAULTSUBMITBATCH)
+			   , "Submitters only: The most payloads sent to the broker in a single message")
+			(  "job_id", po::value<std::uint64_t>(&submission.job_id)->default_value(0)
+			   , "Submitters only: Add the payloads to this job instead of starting a new one")
 			;
 
 		po::variables_map vm;
@@ -123,17 +299,126 @@ int main(int argc, char **argv) {
 			return 0;
 		}
 
+#if defined(ESTRAY_CLOSED_PAYLOAD_SET)
+		std::cout << "Payloads are transferred and processed through the closed payload set" << std::endl;
+#endif
+
+		if (!codec_available(compression.codec)) {
+			std::cerr << "Error: Compression codec " << compression.codec << " is not available in this build" << std::endl;
+			return 1;
+		}
+
+		websocket_transport::set_permessage_deflate(permessage_deflate);
+		buffer_pool::configure(buffer_cache_mb * 1024 * 1024);
+
 		if (is_client) { // We are a client
+			if (0 == pipeline_depth) {
+				std::cerr << "Error: pipeline_depth needs to be at least 1" << std::endl;
+				return 1;
+			}
+
 		    std::cout << "Client with id " << client_id << " is starting up" << std::endl;
 
 			// Use std::make_shared so shared_from_this works
-			std::make_shared<async_websocket_client>(host, port)->run();
+			switch (transport) {
+				case transport_type::websocket:
+					std::make_shared<async_websocket_client<websocket_transport>>(host, port, echo_size, reconnect, client_id, pipeline_depth, client_cores, affinity.numa)->run();
+					break;
+
+				case transport_type::tcp:
+					std::make_shared<async_websocket_client<framed_transport<tcp>>>(host, port, echo_size, reconnect, client_id, pipeline_depth, client_cores, affinity.numa)->run();
+					break;
+
+				case transport_type::unix_socket:
+					std::make_shared<async_websocket_client<framed_transport<local_stream>>>(socket_path, port, echo_size, reconnect, client_id, pipeline_depth, client_cores, affinity.numa)->run();
+					break;
+
+				case transport_type::shm:
+					std::make_shared<async_websocket_client<shm_transport>>(socket_path, port, echo_size, reconnect, client_id, pipeline_depth, client_cores, affinity.numa)->run();
+					break;
+			}
 
             std::cout << "Client with id " << client_id << " has terminated" << std::endl;
+		} else if (is_submitter) { // We hand a job to a broker
+			if (transport_type::websocket != transport) {
+				std::cerr << "Error: Submitters connect through the websocket transport" << std::endl;
+				return 1;
+			}
+
+			if (0 == submission.batch_size) {
+				std::cerr << "Error: submit_batch needs to be at least 1" << std::endl;
+				return 1;
+			}
+
+			std::mt19937 mersenne(0 != seed ? seed : std::random_device()());
+			std::normal_distribution<double> normalDist(0., 1.);
+
+			job_submitter submitter(host, port, submission, compression);
+			auto n_verified = submitter.run([&](std::size_t /* index */) -> payload_base * {
+				if (payload_type::sleep == pType) return new sleep_payload(payload_sleep_time);
+				return new random_container_payload(container_size, normalDist, mersenne);
+			});
+
+			if (n_verified != submission.n_payloads) {
+				std::cerr << "Error: Only " << n_verified << " of " << submission.n_payloads << " results could be verified" << std::endl;
+				return 1;
+			}
 		} else { // We are a server
+			if (broker.enabled && (echo_size > 0 || !replay_path.empty() || !spool_path.empty() || !create_spool_path.empty()
+				|| !sort.output_path.empty() || !spill_dir.empty() || target_item_ms > 0.)) {
+				std::cerr << "Error: --broker cannot be combined with --echo_size, --replay, spools, --sort_output, --spill_dir or --target_item_ms" << std::endl;
+				return 1;
+			}
+
+			// The default limit is meant for benchmark runs. A broker serves until it is stopped, unless asked otherwise.
+			if (broker.enabled && vm["max_n_served"].defaulted()) max_n_served = 0;
+
+			if (0 == max_n_served && max_duration <= 0. && !broker.enabled) {
+				std::cerr << "Error: At least one of max_n_served and max_duration needs to be set" << std::endl;
+				return 1;
+			}
+
+			if (!spool_path.empty() && (!replay_path.empty() || !create_spool_path.empty())) {
+				std::cerr << "Error: --spool cannot be combined with --replay or --create_spool" << std::endl;
+				return 1;
+			}
+
+			if (!spill_dir.empty() && (echo_size > 0 || !replay_path.empty() || !spool_path.empty() || !sort.output_path.empty())) {
+				std::cerr << "Error: --spill_dir cannot be combined with --echo_size, --replay, --spool or --sort_output" << std::endl;
+				return 1;
+			}
+
+			if (!sort.output_path.empty()
+				&& (payload_type::container != pType || echo_size > 0 || !replay_path.empty() || !spool_path.empty() || !create_spool_path.empty())) {
+				std::cerr << "Error: --sort_output needs container payloads and cannot be combined with --echo_size, --replay or spools" << std::endl;
+				return 1;
+			}
+
+			// Submitters get exactly one result per payload, and a sort only ends once all of its runs are
+			// back. Neither may depend on clients staying alive.
+			tracking.enabled = tracking.enabled || tracking.timeout > 0. || tracking.speculative || broker.enabled
+				|| !sort.output_path.empty();
+			broker.max_pending_bytes = broker_pending_mb * 1024 * 1024;
+			granularity.target_time = target_item_ms / 1000.;
+			if (0 == granularity.max_units) {
+				std::cerr << "Error: max_batch needs to be at least 1" << std::endl;
+				return 1;
+			}
+
+			if (granularity.target_time > 0.
+				&& (payload_type::container != pType || echo_size > 0 || !spool_path.empty() || !sort.output_path.empty())) {
+				std::cerr << "Error: --target_item_ms needs container payloads and cannot be combined with --echo_size, --spool or --sort_output" << std::endl;
+				return 1;
+			}
+
+			if (!create_spool_path.empty() && 0 == max_n_served) {
+				std::cerr << "Error: --create_spool needs max_n_served to be set" << std::endl;
+				return 1;
+			}
+
 			auto start = std::chrono::system_clock::now();
 			// Start the actual server and measure its runtime in milliseconds
-			std::make_shared<async_websocket_server>(
+			auto server_ptr = std::make_shared<async_websocket_server>(
 				host
 				, port
 				, n_context_threads
@@ -141,17 +426,51 @@ int main(int argc, char **argv) {
 				, max_n_served
 				, pType
 				, container_size
+				, generator
+				, seed
+				, record_path
+				, replay_path
+				, spool_path
 				, payload_sleep_time
 				, full_queue_sleep_ms
 				, max_queue_size
-			)->run();
+				, warm_up_time
+				, cool_down_time
+				, sample_interval_ms
+				, max_duration
+				, echo_size
+				, transport
+				, socket_path
+				, shm_ring_size_mb * 1024 * 1024
+				, flat_containers
+				, compression
+				, result_sink_settings{result_path, result_batch_kb * 1024, result_max_pending_mb * 1024 * 1024}
+				, sort
+				, granularity
+				, tracking
+				, slow_client_fraction
+				, drain_timeout
+				, affinity
+				, spill_settings{spill_dir, spill_max_mb * 1024 * 1024, std::max<std::size_t>(1, spill_segment_mb) * 1024 * 1024}
+				, broker
+			);
+
+			if (!create_spool_path.empty()) {
+				std::cout
+				    << "Wrote " << server_ptr->create_spool(create_spool_path, max_n_served)
+				    << " work items to " << create_spool_path << std::endl;
+				return 0;
+			}
+
+			server_ptr->run();
 			auto end = std::chrono::system_clock::now();
 
 			auto nMilliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(end-start).count();
 
+			// Note that this figure includes start-up and shutdown. See the steady-state figures above.
 			std::cout
 			    << "Used " << nMilliseconds << " ms" << std::endl
-			    << "This amounts to " << 1000*double(max_n_served)/double(std::chrono::duration_cast<std::chrono::milliseconds>(end-start).count()) << " packages/s" << std::endl;
+			    << "This amounts to " << 1000*double(server_ptr->get_n_packages_served())/double(nMilliseconds) << " packages/s (overall)" << std::endl;
 		}
 	} catch (std::exception &e) {
 		std::cerr << "Exception in main(): " << e.what() << std::endl;
@@ -135,6 +135,98 @@ std::istream &operator>>(std::istream &i, payload_type &am) {
 
 /******************************************************************************************/
 
+std::ostream &operator<<(std::ostream &o, const random_generator &rg) {
+    auto tmp = static_cast<ENUMBASETYPE>(rg);
+    o << tmp;
+    return o;
+}
+
+/******************************************************************************************/
+
+std::istream &operator>>(std::istream &i, random_generator &rg) {
+    ENUMBASETYPE tmp;
+    i >> tmp;
+
+#ifdef DEBUG
+    rg = boost::numeric_cast<random_generator>(tmp);
+#else
+    rg = static_cast<random_generator>(tmp);
+#endif /* DEBUG */
+
+    return i;
+}
+
+/******************************************************************************************/
+
+std::ostream &operator<<(std::ostream &o, const transport_type &tt) {
+    auto tmp = static_cast<ENUMBASETYPE>(tt);
+    o << tmp;
+    return o;
+}
+
+/******************************************************************************************/
+
+std::istream &operator>>(std::istream &i, transport_type &tt) {
+    ENUMBASETYPE tmp;
+    i >> tmp;
+
+#ifdef DEBUG
+    tt = boost::numeric_cast<transport_type>(tmp);
+#else
+    tt = static_cast<transport_type>(tmp);
+#endif /* DEBUG */
+
+    return i;
+}
+
+/******************************************************************************************/
+
+std::ostream &operator<<(std::ostream &o, const compression_codec &cc) {
+    auto tmp = static_cast<ENUMBASETYPE>(cc);
+    o << tmp;
+    return o;
+}
+
+/******************************************************************************************/
+
+std::istream &operator>>(std::istream &i, compression_codec &cc) {
+    ENUMBASETYPE tmp;
+    i >> tmp;
+
+#ifdef DEBUG
+    cc = boost::numeric_cast<compression_codec>(tmp);
+#else
+    cc = static_cast<compression_codec>(tmp);
+#endif /* DEBUG */
+
+    return i;
+}
+
+/******************************************************************************************/
+
+std::ostream &operator<<(std::ostream &o, const compression_filter &cf) {
+    auto tmp = static_cast<ENUMBASETYPE>(cf);
+    o << tmp;
+    return o;
+}
+
+/******************************************************************************************/
+
+std::istream &operator>>(std::istream &i, compression_filter &cf) {
+    ENUMBASETYPE tmp;
+    i >> tmp;
+
+#ifdef DEBUG
+    cf = boost::numeric_cast<compression_filter>(tmp);
+#else
+    cf = static_cast<compression_filter>(tmp);
+#endif /* DEBUG */
+
+    return i;
+}
+
+/******************************************************************************************/
+
 /**
  * Creation of a fixed-width command-string to be transmitted between client and server
  */
@@ -152,4 +244,276 @@ std::string text_command_string(const std::string &cmd, std::size_t command_leng
     return command_stream.str();
 }
 
-/******************************************************************************************/
\ No newline at end of file
+/******************************************************************************************/
+
+/**
+ * Retrieves the control frame for a command. All frames are built once, on first use.
+ */
+const std::string &control_frame(payload_command command) {
+    static const auto frames = []() {
+        std::array<std::string, static_cast<std::size_t>(payload_command::NONE) + 1> f;
+        for (std::size_t i = 0; i < f.size(); i++) {
+            f[i] = std::string(CONTROLFRAMEMARKER) + text_command_string(std::to_string(i), CONTROLCOMMANDLENGTH);
+        }
+        return f;
+    }();
+
+    return frames.at(static_cast<std::size_t>(command));
+}
+
+/******************************************************************************************/
+
+/**
+ * Checks whether a message is a control frame and extracts the command, if so. Anything
+ * else (in particular serialized command_container objects) leads to a return value of false.
+ */
+bool parse_control_frame(const char *data, std::size_t size, payload_command &command) {
+    if (size != CONTROLFRAMESIZE || 0 != std::memcmp(data, CONTROLFRAMEMARKER, CONTROLFRAMEMARKERLENGTH)) {
+        return false;
+    }
+
+    // The command is right-aligned within its field
+    const char *first = data + CONTROLFRAMEMARKERLENGTH;
+    const char *last = data + CONTROLFRAMESIZE;
+    while (first != last && *first == ' ') ++first;
+
+    ENUMBASETYPE tmp = 0;
+    auto result = std::from_chars(first, last, tmp);
+    if (result.ec != std::errc() || result.ptr != last || tmp > static_cast<ENUMBASETYPE>(payload_command::NONE)) {
+        return false;
+    }
+
+    command = static_cast<payload_command>(tmp);
+    return true;
+}
+
+/******************************************************************************************/
+
+std::string hello_frame(const client_hello &hello) {
+    std::ostringstream frame;
+    frame
+            << control_frame(payload_command::HELLO)
+            << " resume_token=" << hello.resume_token
+            << " pending_result=" << (hello.pending_result ? 1 : 0)
+            << " client_id=" << hello.client_id
+            << " n_cores=" << hello.n_cores
+            << " speed=" << hello.speed;
+    return frame.str();
+}
+
+/******************************************************************************************/
+
+/**
+ * Checks whether a message is a HELLO frame and extracts its fields, if so. Unknown keys and
+ * malformed pairs are skipped.
+ */
+bool parse_hello_frame(const char *data, std::size_t size, client_hello &hello) {
+    const auto &marker = control_frame(payload_command::HELLO);
+    if (size < marker.size() || 0 != std::memcmp(data, marker.data(), marker.size())) {
+        return false;
+    }
+
+    hello = client_hello{};
+
+    const char *pos = data + marker.size();
+    const char *end = data + size;
+    while (pos != end) {
+        while (pos != end && *pos == ' ') ++pos;
+        const char *pair_end = std::find(pos, end, ' ');
+        const char *separator = std::find(pos, pair_end, '=');
+
+        if (separator != pair_end) {
+            std::string key(pos, separator);
+            std::uint64_t value = 0;
+            auto result = std::from_chars(separator + 1, pair_end, value);
+            if (result.ec == std::errc() && result.ptr == pair_end) {
+                if ("resume_token" == key) hello.resume_token = value;
+                else if ("pending_result" == key) hello.pending_result = (0 != value);
+                else if ("client_id" == key) hello.client_id = value;
+                else if ("n_cores" == key) hello.n_cores = value;
+                else if ("speed" == key) hello.speed = value;
+            }
+        }
+
+        pos = pair_end;
+    }
+
+    return true;
+}
+
+/******************************************************************************************/
+
+std::string broker_header_string(const broker_header &header) {
+    std::ostringstream frame;
+    frame
+            << control_frame(header.command)
+            << " job_id=" << header.job_id
+            << " n_records=" << header.n_records
+            << " n_submitted=" << header.n_submitted
+            << " n_completed=" << header.n_completed
+            << " n_collected=" << header.n_collected
+            << '\n';
+    return frame.str();
+}
+
+/******************************************************************************************/
+
+/**
+ * Checks whether a message starts with a broker header and extracts its fields, if so. The
+ * body starts at body_offset. Unknown keys and malformed pairs are skipped.
+ */
+bool parse_broker_header(const char *data, std::size_t size, broker_header &header, std::size_t &body_offset) {
+    if (size < CONTROLFRAMESIZE) return false;
+
+    payload_command command = payload_command::NONE;
+    if (!parse_control_frame(data, CONTROLFRAMESIZE, command)) return false;
+    if (payload_command::SUBMIT != command && payload_command::ACCEPTED != command
+        && payload_command::COLLECT != command && payload_command::RESULTS != command
+        && payload_command::REJECTED != command) {
+        return false;
+    }
+
+    const char *end = std::find(data + CONTROLFRAMESIZE, data + size, '\n');
+    if (end == data + size) return false;
+
+    header = broker_header{};
+    header.command = command;
+    body_offset = static_cast<std::size_t>(end - data) + 1;
+
+    const char *pos = data + CONTROLFRAMESIZE;
+    while (pos != end) {
+        while (pos != end && *pos == ' ') ++pos;
+        const char *pair_end = std::find(pos, end, ' ');
+        const char *separator = std::find(pos, pair_end, '=');
+
+        if (separator != pair_end) {
+            std::string key(pos, separator);
+            std::uint64_t value = 0;
+            auto result = std::from_chars(separator + 1, pair_end, value);
+            if (result.ec == std::errc() && result.ptr == pair_end) {
+                if ("job_id" == key) header.job_id = value;
+                else if ("n_records" == key) header.n_records = value;
+                else if ("n_submitted" == key) header.n_submitted = value;
+                else if ("n_completed" == key) header.n_completed = value;
+                else if ("n_collected" == key) header.n_collected = value;
+            }
+        }
+
+        pos = pair_end;
+    }
+
+    return true;
+}
+
+/******************************************************************************************/
+
+void append_broker_record(std::string &body, const char *data, std::size_t size) {
+    auto record_size = boost::endian::native_to_little(std::uint64_t(size));
+    body.append(reinterpret_cast<const char *>(&record_size), sizeof(record_size));
+    body.append(data, size);
+}
+
+/******************************************************************************************/
+
+bool next_broker_record(const char *data, std::size_t size, std::size_t &offset, const char *&record, std::size_t &record_size) {
+    if (offset == size) return false;
+
+    std::uint64_t tmp = 0;
+    if (size - offset < sizeof(tmp)) throw std::runtime_error("next_broker_record(): Truncated record size");
+    std::memcpy(&tmp, data + offset, sizeof(tmp));
+    tmp = boost::endian::little_to_native(tmp);
+    offset += sizeof(tmp);
+
+    if (tmp > size - offset) throw std::runtime_error("next_broker_record(): Truncated record");
+    record = data + offset;
+    record_size = static_cast<std::size_t>(tmp);
+    offset += record_size;
+    return true;
+}
+
+/******************************************************************************************/
+
+/**
+ * Sorts a block of random numbers a few times and reports the best rate, so short hiccups
+ * do not distort the result. Takes a few milliseconds.
+ */
+std::uint64_t measure_sort_speed() {
+    const std::size_t n_values = 1U << 16U;
+    const std::size_t n_repetitions = 5;
+
+    std::mt19937_64 rng(n_values);
+    std::uniform_real_distribution<double> dist(0., 1.);
+    std::vector<double> original(n_values);
+    for (auto &value: original) value = dist(rng);
+
+    double best_time = 0.;
+    std::vector<double> values;
+    for (std::size_t r = 0; r < n_repetitions; r++) {
+        values = original;
+        auto start = std::chrono::steady_clock::now();
+        std::sort(values.begin(), values.end());
+        auto time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (0 == r || time < best_time) best_time = time;
+    }
+
+    return best_time > 0. ? static_cast<std::uint64_t>(double(n_values) / best_time) : 0;
+}
+
+/******************************************************************************************/
+
+/**
+ * Creation of an opaque message for transport-only measurements. The content consists of printable
+ * characters only, so it is valid UTF-8 and may be sent in text mode as well.
+ */
+std::string make_echo_blob(std::size_t size) {
+    std::string blob(size, ' ');
+    for (std::size_t i = 0; i < size; i++) {
+        blob[i] = static_cast<char>('a' + i % 26);
+    }
+    return blob;
+}
+
+/******************************************************************************************/
+
+/**
+ * Calculates mean, minimum, maximum and variance of a series of throughput measurements
+ */
+throughput_summary summarize_throughput(const std::vector<double> &rates) {
+    throughput_summary ts;
+    if (rates.empty()) return ts;
+
+    ts.n_windows = rates.size();
+    ts.min = *std::min_element(rates.begin(), rates.end());
+    ts.max = *std::max_element(rates.begin(), rates.end());
+
+    double sum = 0.;
+    for (const auto &r: rates) sum += r;
+    ts.mean = sum / double(rates.size());
+
+    if (rates.size() > 1) {
+        double sq_sum = 0.;
+        for (const auto &r: rates) sq_sum += (r - ts.mean) * (r - ts.mean);
+        ts.variance = sq_sum / double(rates.size() - 1);
+    }
+
+    return ts;
+}
+
+/******************************************************************************************/
+
+std::ostream &operator<<(std::ostream &o, const throughput_summary &ts) {
+    if (0 == ts.n_windows) {
+        o << "No steady-state windows available (run too short for warm-up / cool-down settings?)";
+        return o;
+    }
+
+    o
+        << "steady-state over " << ts.n_windows << " windows: "
+        << "mean = " << ts.mean << " packages/s, "
+        << "min = " << ts.min << " packages/s, "
+        << "max = " << ts.max << " packages/s, "
+        << "variance = " << ts.variance << " (std. dev. = " << std::sqrt(ts.variance) << ")";
+    return o;
+}
+
+/******************************************************************************************/
@@ -48,9 +48,18 @@
 #include <iomanip>
 #include <stdexcept>
 #include <chrono>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <charconv>
+#include <array>
+#include <random>
+#include <cstdint>
 
 // Boost headers go here
 #include <boost/cast.hpp>
+#include <boost/endian/conversion.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/websocket.hpp>
 #include <boost/beast/websocket/rfc6455.hpp>
@@ -64,13 +73,16 @@
 void set_transfer_mode(boost::beast::websocket::stream<boost::beast::tcp_stream> &);
 
 const std::chrono::seconds DEFAULTPINGINTERVAL = std::chrono::seconds(5); // NOLINT
+const std::size_t CLOSEGRACEPERIODMS = 1000; ///< How long a server waits for clients to react to TERMINATE, once its drain timeout has passed
+const std::size_t KEPTBUFFERSIZE = std::size_t(64) * 1024; ///< Sessions keep message buffers up to this size between messages
 
 /** @brief A basetype used for all enums in the Evaluator */
 using ENUMBASETYPE = unsigned int;
 
 /** @brief Ids of the allowed commands for the Evaluator protocol */
 enum class payload_command : ENUMBASETYPE {
-    GETDATA = 0, NODATA = 1, COMPUTE = 2, RESULT = 3, ERROR = 4, TERMINATE = 5, NONE = 6
+    GETDATA = 0, NODATA = 1, COMPUTE = 2, RESULT = 3, ERROR = 4, TERMINATE = 5, HELLO = 6
+    , SUBMIT = 7, ACCEPTED = 8, COLLECT = 9, RESULTS = 10, REJECTED = 11, NONE = 12
 };
 
 
@@ -93,7 +105,115 @@ enum class payload_type : ENUMBASETYPE {
 std::ostream &operator<<(std::ostream &o, const payload_type &am);
 std::istream &operator>>(std::istream &i, payload_type &am);
 
+/** @brief Indicates how the random numbers of container payloads are produced */
+enum class random_generator : ENUMBASETYPE {
+    mt19937 = 0, xoshiro = 1
+};
+
+std::ostream &operator<<(std::ostream &o, const random_generator &rg);
+std::istream &operator>>(std::istream &i, random_generator &rg);
+
+/** @brief Indicates which transport should be used between server sessions and clients */
+enum class transport_type : ENUMBASETYPE {
+    websocket = 0, tcp = 1, unix_socket = 2, shm = 3
+};
+
+std::ostream &operator<<(std::ostream &o, const transport_type &tt);
+std::istream &operator>>(std::istream &i, transport_type &tt);
+
+/** @brief The codecs available for the compression of messages */
+enum class compression_codec : ENUMBASETYPE {
+    none = 0, zlib = 1, lz4 = 2, zstd = 3
+};
+
+std::ostream &operator<<(std::ostream &o, const compression_codec &cc);
+std::istream &operator>>(std::istream &i, compression_codec &cc);
+
+/** @brief Reversible transformations applied to messages before compression */
+enum class compression_filter : ENUMBASETYPE {
+    none = 0, shuffle = 1, xor_delta = 2, xor_shuffle = 3
+};
+
+std::ostream &operator<<(std::ostream &o, const compression_filter &cf);
+std::istream &operator>>(std::istream &i, compression_filter &cf);
+
 /** @brief Creation of a fixed-width command-string to be transmitted between client and server */
 std::string text_command_string(const std::string &cmd, std::size_t command_length);
 
+/**
+ * Messages without payload (e.g. GETDATA, NODATA, TERMINATE) are transmitted as compact, fixed-size
+ * control frames instead of Boost.Serialization archives: A marker followed by the numeric command,
+ * formatted by text_command_string(). Control frames consist of printable characters only, so they
+ * may be sent in text as well as binary mode. The marker cannot appear at the start of any archive.
+ */
+const char CONTROLFRAMEMARKER[] = "#ESTRAY:";
+const std::size_t CONTROLFRAMEMARKERLENGTH = sizeof(CONTROLFRAMEMARKER) - 1;
+const std::size_t CONTROLCOMMANDLENGTH = 4;
+const std::size_t CONTROLFRAMESIZE = CONTROLFRAMEMARKERLENGTH + CONTROLCOMMANDLENGTH;
+
+/** @brief Retrieves the (pre-built) control frame for a command */
+const std::string &control_frame(payload_command command);
+
+/** @brief Checks whether a message is a control frame and extracts the command, if so */
+bool parse_control_frame(const char *data, std::size_t size, payload_command &command);
+
+/**
+ * The first message of a client on each connection: The HELLO control frame, followed by
+ * space-separated key=value pairs. Unknown keys are ignored, so fields may be added later.
+ */
+struct client_hello {
+    std::uint64_t resume_token = 0; ///< Identifies the client across reconnects
+    bool pending_result = false; ///< Whether the client will send the result of its last work item next
+    std::uint64_t client_id = 0; ///< As given on the command line of the client
+    std::uint64_t n_cores = 0; ///< The number of hardware threads of the client
+    std::uint64_t speed = 0; ///< Values per second sorted by the client in a short benchmark
+};
+
+/** @brief A short benchmark of the local machine: The number of values sorted per second */
+std::uint64_t measure_sort_speed();
+
+std::string hello_frame(const client_hello &hello);
+bool parse_hello_frame(const char *data, std::size_t size, client_hello &hello);
+
+/**
+ * Messages between submitters and a broker start with a header: The control frame of SUBMIT,
+ * ACCEPTED, COLLECT, RESULTS or REJECTED, followed by space-separated key=value pairs and a
+ * newline. SUBMIT and RESULTS messages then carry a body of records, each consisting of its
+ * size as an 8-byte little-endian number and its content (payloads as created by to_binary(),
+ * or results as received from the clients). REJECTED answers invalid requests (such as unknown
+ * job ids or malformed records), its body holds the reason as text.
+ */
+struct broker_header {
+    payload_command command = payload_command::NONE;
+    std::uint64_t job_id = 0; ///< 0 in a SUBMIT message asks for a new job
+    std::uint64_t n_records = 0; ///< SUBMIT, RESULTS: The records in the body. ACCEPTED, REJECTED: The payloads taken. COLLECT: The most results wanted
+    std::uint64_t n_submitted = 0; ///< ACCEPTED, RESULTS: The payloads accepted for the job so far
+    std::uint64_t n_completed = 0; ///< ACCEPTED, RESULTS: The results that have arrived for the job so far
+    std::uint64_t n_collected = 0; ///< ACCEPTED, RESULTS: The results handed to the submitter so far, including this message
+};
+
+std::string broker_header_string(const broker_header &header);
+bool parse_broker_header(const char *data, std::size_t size, broker_header &header, std::size_t &body_offset);
+
+/** @brief Appends a record (8-byte little-endian size and content) to the body of a broker message */
+void append_broker_record(std::string &body, const char *data, std::size_t size);
+
+/** @brief Reads the record at offset and moves the offset past it. Returns false at the end of the body. Throws on truncated records */
+bool next_broker_record(const char *data, std::size_t size, std::size_t &offset, const char *&record, std::size_t &record_size);
+
+/** @brief Summary statistics of the throughput (packages/s) measured in a series of time windows */
+struct throughput_summary {
+    std::size_t n_windows = 0; ///< The number of windows that entered the statistics
+    double mean = 0.; ///< The mean throughput over all windows
+    double min = 0.; ///< The lowest throughput of all windows
+    double max = 0.; ///< The highest throughput of all windows
+    double variance = 0.; ///< The (sample-) variance of the throughput
+};
+
+/** @brief Creation of an opaque message of a given size for transport-only measurements */
+std::string make_echo_blob(std::size_t size);
+
+throughput_summary summarize_throughput(const std::vector<double> &rates);
+std::ostream &operator<<(std::ostream &o, const throughput_summary &ts);
+
 /******************************************************************************************/
@@ -145,4 +145,107 @@ payload_base *from_binary(const std::string &descr) {
     return payload_ptr;
 }
 
-/******************************************************************************************/
\ No newline at end of file
+/******************************************************************************************/
+
+std::size_t flat_container_size(std::size_t n_values) {
+    return sizeof(flat_container_header) + n_values * sizeof(double);
+}
+
+void write_flat_container(void *target, payload_command command, const random_container_payload &payload) {
+    flat_container_header header{};
+    std::memcpy(header.magic, FLATCONTAINERMAGIC, sizeof(header.magic));
+    header.command = static_cast<std::uint32_t>(command);
+    header.n_values = payload.size();
+
+    auto *pos = static_cast<char *>(target);
+    std::memcpy(pos, &header, sizeof(header));
+    pos += sizeof(header);
+
+    for (std::size_t i = 0; i < payload.size(); i++) {
+        double value = payload.member(i)->value();
+        std::memcpy(pos, &value, sizeof(value));
+        pos += sizeof(value);
+    }
+}
+
+/******************************************************************************************/
+
+flat_container_view::flat_container_view(void *data, std::size_t size) {
+    if (size < sizeof(flat_container_header)) return;
+
+    flat_container_header header{};
+    std::memcpy(&header, data, sizeof(header));
+
+    if (0 != std::memcmp(header.magic, FLATCONTAINERMAGIC, sizeof(header.magic))) return;
+    if (header.command > static_cast<std::uint32_t>(payload_command::NONE)) return;
+    if ((size - sizeof(header)) % sizeof(double) != 0) return;
+    if (header.n_values != (size - sizeof(header)) / sizeof(double)) return;
+
+    m_data = static_cast<char *>(data);
+    m_n_values = header.n_values;
+}
+
+payload_command flat_container_view::get_command() const {
+    std::uint32_t command = 0;
+    std::memcpy(&command, m_data + offsetof(flat_container_header, command), sizeof(command));
+    return static_cast<payload_command>(command);
+}
+
+void flat_container_view::set_command(payload_command command) {
+    auto tmp = static_cast<std::uint32_t>(command);
+    std::memcpy(m_data + offsetof(flat_container_header, command), &tmp, sizeof(tmp));
+}
+
+double flat_container_view::get_processing_time() const {
+    std::uint32_t processing_time_us = 0;
+    std::memcpy(&processing_time_us, m_data + offsetof(flat_container_header, processing_time_us), sizeof(processing_time_us));
+    return double(processing_time_us) / 1.e6;
+}
+
+void flat_container_view::sort() {
+    auto start = std::chrono::steady_clock::now();
+
+    if (aligned()) {
+        std::sort(values(), values() + m_n_values);
+    } else {
+        // The values cannot be accessed directly, so we need to sort a copy
+        std::vector<double> tmp(m_n_values);
+        std::memcpy(tmp.data(), m_data + sizeof(flat_container_header), m_n_values * sizeof(double));
+        std::sort(tmp.begin(), tmp.end());
+        std::memcpy(m_data + sizeof(flat_container_header), tmp.data(), m_n_values * sizeof(double));
+    }
+
+    // Let the server know how long this took (saturating at about 71 minutes)
+    auto processing_time_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    auto stored_time_us = static_cast<std::uint32_t>(std::min<std::int64_t>(processing_time_us, std::numeric_limits<std::uint32_t>::max()));
+    std::memcpy(m_data + offsetof(flat_container_header, processing_time_us), &stored_time_us, sizeof(stored_time_us));
+}
+
+bool flat_container_view::is_sorted() const {
+    if (aligned()) {
+        return std::is_sorted(values(), values() + m_n_values);
+    }
+
+    std::vector<double> tmp(m_n_values);
+    std::memcpy(tmp.data(), m_data + sizeof(flat_container_header), m_n_values * sizeof(double));
+    return std::is_sorted(tmp.begin(), tmp.end());
+}
+
+const double *flat_container_view::data() const noexcept {
+    return aligned() ? values() : nullptr;
+}
+
+void flat_container_view::copy_values(double *target) const {
+    std::memcpy(target, m_data + sizeof(flat_container_header), m_n_values * sizeof(double));
+}
+
+double *flat_container_view::values() const noexcept {
+    return reinterpret_cast<double *>(m_data + sizeof(flat_container_header));
+}
+
+bool flat_container_view::aligned() const noexcept {
+    // Message buffers start at the beginning of their allocation, so this is the normal case
+    return 0 == reinterpret_cast<std::uintptr_t>(m_data) % alignof(double);
+}
+
+/******************************************************************************************/
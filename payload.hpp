@@ -50,6 +50,14 @@
 #include <memory>
 #include <random>
 #include <algorithm>
+#include <thread>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include <chrono>
+#include <limits>
+#include <functional>
 
 // Boost headers go here
 #include <boost/function.hpp>
@@ -79,6 +87,43 @@
 // Our own headers go here
 #include "misc.hpp"
 
+/******************************************************************************************/
+////////////////////////////////////////////////////////////////////////////////////////////
+/******************************************************************************************/
+/**
+ * All payload types known to this program. Each type is identified by its position in this
+ * list (its "type tag"). In builds with ESTRAY_CLOSED_PAYLOAD_SET, payloads are transferred
+ * with this tag instead of the class name registered through BOOST_CLASS_EXPORT, and process()
+ * and is_processed() are dispatched through the tag instead of virtual calls. New payload types
+ * need to be added here.
+ */
+
+class random_container_payload;
+class sleep_payload;
+
+template<typename... payload_ts>
+struct payload_type_list {};
+
+using closed_payload_set = payload_type_list<random_container_payload, sleep_payload>;
+
+template<typename payload_t, typename list_t>
+struct payload_index;
+
+template<typename payload_t, typename... payload_ts>
+struct payload_index<payload_t, payload_type_list<payload_t, payload_ts...>>
+        : std::integral_constant<std::uint8_t, 0> {};
+
+template<typename payload_t, typename other_t, typename... payload_ts>
+struct payload_index<payload_t, payload_type_list<other_t, payload_ts...>>
+        : std::integral_constant<std::uint8_t, 1 + payload_index<payload_t, payload_type_list<payload_ts...>>::value> {};
+
+/** @brief The type tag of a payload type */
+template<typename payload_t>
+constexpr std::uint8_t payload_tag_v = payload_index<payload_t, closed_payload_set>::value;
+
+/** @brief Marks a command_container without payload on the wire */
+const std::uint8_t NOPAYLOADTAG = 0xff;
+
 /******************************************************************************************/
 ////////////////////////////////////////////////////////////////////////////////////////////
 /******************************************************************************************/
@@ -86,31 +131,74 @@
 class payload_base {
     ///////////////////////////////////////////////////////////////
     friend class boost::serialization::access;
+    friend struct closed_payload_access;
 
     template<class Archive>
-    void serialize(Archive &ar, const unsigned int) { /* nothing */ }
+    void serialize(Archive &ar, const unsigned int) {
+        ar & BOOST_SERIALIZATION_NVP(m_processing_time);
+    }
 
     ///////////////////////////////////////////////////////////////
 
 public:
-    payload_base() = default;
-
     virtual ~payload_base() = default;
 
     payload_base(const payload_base &) = default;
 
-    void process() {
-        this->process_();
+    // Defined after the payload types, so the closed payload set may be used for the dispatch
+    void process();
+    bool is_processed();
+
+    /** @brief Whether processing merely waits (e.g. for a timer or for I/O), so async_process() should be used */
+    bool is_latency_bound();
+
+    /**
+     * Processes the payload without blocking the calling thread, if it is latency-bound. Other payloads
+     * are processed right away. The handler is called through the executor once processing is done.
+     * The payload needs to stay alive until then.
+     */
+    void async_process(const boost::asio::any_io_executor &executor, std::function<void()> &&handler);
+
+    [[nodiscard]] std::uint8_t type_tag() const noexcept {
+        return m_type_tag;
     }
 
-    bool is_processed() {
-        return this->is_processed_();
+    /** @brief The time in seconds the last call to process() took. Travels back to the server with the result */
+    [[nodiscard]] double get_processing_time() const noexcept {
+        return m_processing_time;
+    }
+
+    /** @brief The job a payload submitted to a broker belongs to. 0 for payloads of our own producers. Not serialized */
+    [[nodiscard]] std::uint64_t get_job_id() const noexcept {
+        return m_job_id;
     }
 
+    void set_job_id(std::uint64_t job_id) noexcept {
+        m_job_id = job_id;
+    }
+
+protected:
+    // Derived classes identify themselves through their type tag
+    explicit payload_base(std::uint8_t type_tag) : m_type_tag(type_tag) { /* nothing */ }
+
 private:
     virtual void process_() = 0;
 
     virtual bool is_processed_() = 0;
+
+    virtual bool is_latency_bound_() {
+        return false;
+    }
+
+    // Latency-bound payloads override this and complete through the executor
+    virtual void async_process_(const boost::asio::any_io_executor &executor, std::function<void()> &&handler) {
+        this->process_();
+        boost::asio::post(executor, std::move(handler));
+    }
+
+    std::uint8_t m_type_tag; ///< The position of the derived class in closed_payload_set
+    double m_processing_time = 0.;
+    std::uint64_t m_job_id = 0;
 };
 
 /******************************************************************************************/
@@ -127,6 +215,10 @@ std::string to_xml(const payload_base *payload_ptr);
 std::string to_binary(const payload_base *payload_ptr);
 payload_base *from_binary(const std::string &descr);
 
+// Saving and loading of payloads through their type tag (used with ESTRAY_CLOSED_PAYLOAD_SET)
+template<class Archive>
+void serialize_closed_payload(Archive &ar, payload_base *&payload_ptr);
+
 /******************************************************************************************/
 ////////////////////////////////////////////////////////////////////////////////////////////
 /******************************************************************************************/
@@ -137,9 +229,12 @@ class command_container {
 
     template<class Archive>
     void serialize(Archive &ar, const unsigned int) {
-        ar
-        & BOOST_SERIALIZATION_NVP(m_command)
-        & BOOST_SERIALIZATION_NVP(m_payload_ptr);
+        ar & BOOST_SERIALIZATION_NVP(m_command);
+#if defined(ESTRAY_CLOSED_PAYLOAD_SET)
+        serialize_closed_payload(ar, m_payload_ptr);
+#else
+        ar & BOOST_SERIALIZATION_NVP(m_payload_ptr);
+#endif
     }
     ///////////////////////////////////////////////////////////////
 
@@ -194,6 +289,10 @@ public:
         return m_command;
     }
 
+    const payload_base *get_payload() const noexcept {
+        return m_payload_ptr;
+    }
+
     // Processing of the payload (if any)
     void process() {
         if (m_payload_ptr) {
@@ -211,7 +310,25 @@ public:
         }
     }
 
+    bool is_latency_bound() {
+        return m_payload_ptr && m_payload_ptr->is_latency_bound();
+    }
+
+    // Asynchronous processing of the payload. The container needs to stay alive until the handler is called.
+    void async_process(const boost::asio::any_io_executor &executor, std::function<void()> &&handler) {
+        if (m_payload_ptr) {
+            m_payload_ptr->async_process(executor, std::move(handler));
+        } else {
+            throw std::runtime_error("command_container::async_process(): No processing possible as m_payload_ptr is empty.");
+        }
+    }
+
     std::string to_string() const {
+        // Messages without payload are sent as compact control frames
+        if (!m_payload_ptr) {
+            return control_frame(m_command);
+        }
+
         // Reset the internal stream
 #ifdef BINARYARCHIVE
         std::stringstream(std::ios::out | std::ios::binary).swap(m_stringstream);
@@ -236,6 +353,9 @@ public:
     }
 
     void from_string(const std::string &descr) {
+        // Control frames do not need to go through Boost.Serialization
+        if (from_control_frame(descr.data(), descr.size())) return;
+
         command_container local_command_container{payload_command::NONE};
 
         // Reset the internal stream
@@ -262,6 +382,15 @@ public:
         *this = std::move(local_command_container);
     }
 
+    // Resets the object from a control frame. Returns false if the message is not a control frame.
+    bool from_control_frame(const char *data, std::size_t size) {
+        payload_command command{payload_command::NONE};
+        if (!parse_control_frame(data, size, command)) return false;
+
+        this->reset(command);
+        return true;
+    }
+
     std::string to_xml() const {
         // Reset the internal stream
         std::stringstream(std::ios::out).swap(m_stringstream);
@@ -329,6 +458,7 @@ private:
 class random_container_payload : public payload_base {
     ///////////////////////////////////////////////////////////////
     friend class boost::serialization::access;
+    friend struct closed_payload_access;
 
     template<class Archive>
     void serialize(Archive &ar, const unsigned int) {
@@ -342,12 +472,22 @@ class random_container_payload : public payload_base {
 public:
     // Initialize container with random numbers
     template<typename dist_type, typename rng_type>
-    random_container_payload(std::size_t size, dist_type &dist, rng_type &rng) {
+    random_container_payload(std::size_t size, dist_type &dist, rng_type &rng)
+            : payload_base(payload_tag_v<random_container_payload>) {
         for (unsigned int i = 0; i < size; i++) {
             this->add(std::shared_ptr<stored_number>(new stored_number(dist(rng))));
         }
     }
 
+    // Initialize container with pre-computed values
+    explicit random_container_payload(const std::vector<double> &values)
+            : payload_base(payload_tag_v<random_container_payload>) {
+        m_data.reserve(values.size());
+        for (auto value: values) {
+            m_data.push_back(std::make_shared<stored_number>(value));
+        }
+    }
+
     // Copy constructor
     random_container_payload(const random_container_payload &cp) : payload_base(cp) {
         m_data.clear();
@@ -390,9 +530,15 @@ public:
         m_data.push_back(p);
     }
 
+    /** @brief Moves the numbers of another container to the end of this one */
+    void append(random_container_payload &&cp) {
+        m_data.insert(m_data.end(), std::make_move_iterator(cp.m_data.begin()), std::make_move_iterator(cp.m_data.end()));
+        cp.m_data.clear();
+    }
+
 private:
     // Only needed for de-serialization
-    random_container_payload() = default;
+    random_container_payload() : payload_base(payload_tag_v<random_container_payload>) { /* nothing */ }
 
     void process_() override {
         this->sort();
@@ -413,6 +559,74 @@ private:
     std::vector<std::shared_ptr<stored_number>> m_data;
 };
 
+/******************************************************************************************/
+////////////////////////////////////////////////////////////////////////////////////////////
+/******************************************************************************************/
+/**
+ * An in-place readable wire format for random_container_payload objects: A fixed-size header,
+ * followed by a contiguous array of doubles. Clients may sort the values directly in their
+ * receive buffer and send the same bytes back, and the server may check the result without
+ * creating any objects. Values are stored in native byte order, so -- just like the binary
+ * archive -- this format assumes the same architecture on server and clients.
+ */
+
+const char FLATCONTAINERMAGIC[] = "#ESTFLC#";
+
+struct flat_container_header {
+    char magic[8]; ///< Always holds FLATCONTAINERMAGIC (without the trailing zero)
+    std::uint32_t command; ///< The payload_command
+    std::uint32_t processing_time_us; ///< The time sort() took in microseconds. 0 for unprocessed containers
+    std::uint64_t n_values; ///< The number of doubles following the header
+};
+
+static_assert(sizeof(FLATCONTAINERMAGIC) - 1 == sizeof(flat_container_header::magic), "Invalid magic size");
+static_assert(sizeof(flat_container_header) % alignof(double) == 0, "Values following the header would be misaligned");
+
+/** @brief The size in bytes of a flat container message holding n_values doubles */
+std::size_t flat_container_size(std::size_t n_values);
+
+/** @brief Writes a flat container message to target, which must hold flat_container_size(payload.size()) bytes */
+void write_flat_container(void *target, payload_command command, const random_container_payload &payload);
+
+/**
+ * A view of a flat container message inside a buffer. The view does not own the data.
+ * If the message is not a valid flat container message, valid() returns false.
+ */
+class flat_container_view {
+public:
+    flat_container_view(void *data, std::size_t size);
+
+    [[nodiscard]] bool valid() const noexcept {
+        return m_data != nullptr;
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept {
+        return m_n_values;
+    }
+
+    [[nodiscard]] payload_command get_command() const;
+    void set_command(payload_command command);
+
+    /** @brief The time in seconds the last call to sort() took, as stored in the header */
+    [[nodiscard]] double get_processing_time() const;
+
+    // Processing and the corresponding check, performed on the values inside the buffer
+    void sort();
+    [[nodiscard]] bool is_sorted() const;
+
+    /** @brief The values inside the buffer, or nullptr if they are not suitably aligned for direct access */
+    [[nodiscard]] const double *data() const noexcept;
+    /** @brief Copies the values to target, which must hold size() doubles */
+    void copy_values(double *target) const;
+
+private:
+    [[nodiscard]] double *values() const noexcept;
+    [[nodiscard]] bool aligned() const noexcept;
+
+    char *m_data = nullptr;
+    std::size_t m_n_values = 0;
+};
+
 /******************************************************************************************/
 ////////////////////////////////////////////////////////////////////////////////////////////
 /******************************************************************************************/
@@ -420,6 +634,7 @@ private:
 class sleep_payload : public payload_base {
     ///////////////////////////////////////////////////////////////
     friend class boost::serialization::access;
+    friend struct closed_payload_access;
 
     template<class Archive>
     void serialize(Archive &ar, const unsigned int) {
@@ -432,7 +647,8 @@ class sleep_payload : public payload_base {
 
 public:
     // Initialize with the sleep duration in seconds (a double number, i.e. you can say "sleep 1.5 seconds)
-    explicit sleep_payload(double sleep_time) : m_sleep_time(sleep_time) { /* default */ }
+    explicit sleep_payload(double sleep_time)
+            : payload_base(payload_tag_v<sleep_payload>), m_sleep_time(sleep_time) { /* default */ }
 
     // Copy constructor
     sleep_payload(const sleep_payload &) = default;
@@ -445,7 +661,7 @@ public:
 
 private:
     // Only needed for de-serialization
-    sleep_payload() = default;
+    sleep_payload() : payload_base(payload_tag_v<sleep_payload>) { /* nothing */ }
 
     void process_() override {
         std::this_thread::sleep_for(std::chrono::duration<double>(m_sleep_time));
@@ -455,11 +671,149 @@ private:
         return true;
     }
 
+    bool is_latency_bound_() override {
+        return true;
+    }
+
+    // A timer takes the place of the sleeping thread
+    void async_process_(const boost::asio::any_io_executor &executor, std::function<void()> &&handler) override {
+        auto timer = std::make_shared<boost::asio::steady_timer>(
+                executor
+                , std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(m_sleep_time)));
+        timer->async_wait([timer, handler = std::move(handler)](const boost::system::error_code &) { handler(); });
+    }
+
     //-------------------------------------------------
     // Data
     double m_sleep_time = 0.;
 };
 
+/******************************************************************************************/
+////////////////////////////////////////////////////////////////////////////////////////////
+/******************************************************************************************/
+/**
+ * Compile-time dispatch over the closed payload set. closed_payload_access calls the private
+ * functions of the payload types without going through the virtual function table.
+ */
+
+struct closed_payload_access {
+    template<typename payload_t>
+    static payload_base *create() {
+        return new payload_t();
+    }
+
+    template<typename payload_t>
+    static void process(payload_t &payload) {
+        payload.payload_t::process_();
+    }
+
+    template<typename payload_t>
+    static bool is_processed(payload_t &payload) {
+        return payload.payload_t::is_processed_();
+    }
+
+    template<typename payload_t>
+    static bool is_latency_bound(payload_t &payload) {
+        return payload.payload_t::is_latency_bound_();
+    }
+
+    template<typename payload_t>
+    static void async_process(payload_t &payload, const boost::asio::any_io_executor &executor, std::function<void()> &&handler) {
+        payload.payload_t::async_process_(executor, std::move(handler));
+    }
+};
+
+/** @brief Calls f with the payload, cast to its actual type. Throws on unknown type tags */
+template<typename function_t, typename... payload_ts>
+void visit_payload(payload_base &payload, function_t &&f, payload_type_list<payload_ts...>) {
+    bool found = ((payload.type_tag() == payload_tag_v<payload_ts>
+                   ? (f(static_cast<payload_ts &>(payload)), true)
+                   : false) || ...);
+
+    if (!found) {
+        throw std::runtime_error("visit_payload(): Got unknown type tag " + std::to_string(payload.type_tag()));
+    }
+}
+
+/** @brief Creates an empty payload object for a type tag. Throws on unknown type tags */
+template<typename... payload_ts>
+payload_base *create_payload(std::uint8_t type_tag, payload_type_list<payload_ts...>) {
+    payload_base *payload_ptr = nullptr;
+    bool found = ((type_tag == payload_tag_v<payload_ts>
+                   ? (payload_ptr = closed_payload_access::create<payload_ts>(), true)
+                   : false) || ...);
+
+    if (!found) {
+        throw std::runtime_error("create_payload(): Got unknown type tag " + std::to_string(type_tag));
+    }
+
+    return payload_ptr;
+}
+
+template<class Archive>
+void serialize_closed_payload(Archive &ar, payload_base *&payload_ptr) {
+    std::uint8_t type_tag = payload_ptr ? payload_ptr->type_tag() : NOPAYLOADTAG;
+    ar & boost::serialization::make_nvp("type_tag", type_tag);
+
+    if constexpr (Archive::is_loading::value) {
+        delete payload_ptr;
+        payload_ptr = (NOPAYLOADTAG == type_tag) ? nullptr : create_payload(type_tag, closed_payload_set{});
+    }
+
+    if (payload_ptr) {
+        visit_payload(*payload_ptr, [&ar](auto &payload) {
+            ar & boost::serialization::make_nvp("payload", payload);
+        }, closed_payload_set{});
+    }
+}
+
+inline void payload_base::process() {
+    auto start = std::chrono::steady_clock::now();
+#if defined(ESTRAY_CLOSED_PAYLOAD_SET)
+    visit_payload(*this, [](auto &payload) { closed_payload_access::process(payload); }, closed_payload_set{});
+#else
+    this->process_();
+#endif
+    m_processing_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+inline bool payload_base::is_processed() {
+#if defined(ESTRAY_CLOSED_PAYLOAD_SET)
+    bool result = false;
+    visit_payload(*this, [&result](auto &payload) { result = closed_payload_access::is_processed(payload); }, closed_payload_set{});
+    return result;
+#else
+    return this->is_processed_();
+#endif
+}
+
+inline bool payload_base::is_latency_bound() {
+#if defined(ESTRAY_CLOSED_PAYLOAD_SET)
+    bool result = false;
+    visit_payload(*this, [&result](auto &payload) { result = closed_payload_access::is_latency_bound(payload); }, closed_payload_set{});
+    return result;
+#else
+    return this->is_latency_bound_();
+#endif
+}
+
+inline void payload_base::async_process(const boost::asio::any_io_executor &executor, std::function<void()> &&handler) {
+    // The processing time includes the wait, as with process()
+    auto start = std::chrono::steady_clock::now();
+    std::function<void()> when_done = [this, start, handler = std::move(handler)]() {
+        m_processing_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        handler();
+    };
+
+#if defined(ESTRAY_CLOSED_PAYLOAD_SET)
+    visit_payload(*this, [&executor, &when_done](auto &payload) {
+        closed_payload_access::async_process(payload, executor, std::move(when_done));
+    }, closed_payload_set{});
+#else
+    this->async_process_(executor, std::move(when_done));
+#endif
+}
+
 /******************************************************************************************/
 ////////////////////////////////////////////////////////////////////////////////////////////
 /******************************************************************************************/
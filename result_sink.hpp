@@ -0,0 +1,269 @@
+/**
+ * @file result_sink.hpp
+ */
+
+/*
+ * The following license applies to the code in this file:
+ *
+ * **************************************************************************
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * **************************************************************************
+ *
+ * Author: Dr. Rüdiger Berlich of Gemfony scientific UG (haftungsbeschraenkt)
+ * See http://www.gemfony.eu for further information.
+ *
+ * This code is based on the Beast Websocket library by Vinnie Falco.
+ */
+
+#pragma once
+
+/******************************************************************************************/
+/*
+ * Storage of the results returned by clients. A result file starts with RESULTFILEMAGIC,
+ * followed by one record per result: its size as an 8-byte little-endian number and the
+ * result message as received (after decompression), i.e. either a flat container or a
+ * serialized command_container. Results are collected in memory by the I/O threads and
+ * written in large batches by a dedicated writer thread, so the network path never waits
+ * for the disk. If the disk falls behind by more than the configured amount of memory,
+ * further results are dropped (and counted) rather than stalling the I/O threads.
+ */
+
+// Standard headers go here
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Boost headers go here
+#include <boost/endian/conversion.hpp>
+
+// Our own headers go here
+// Nothing
+
+/******************************************************************************************/
+
+const char RESULTFILEMAGIC[] = "#ESTRES#";
+const std::size_t RESULTFILEMAGICLENGTH = sizeof(RESULTFILEMAGIC) - 1;
+
+/** @brief The settings of the result sink */
+struct result_sink_settings {
+    std::string path; ///< No results are stored if this is empty
+    std::size_t batch_size = 4 * 1024 * 1024; ///< The writer thread wakes up once this many bytes are pending
+    std::size_t max_pending = 256 * 1024 * 1024; ///< Results are dropped if more bytes than this wait for the disk
+    std::chrono::milliseconds flush_interval{1000}; ///< Pending results are written at least this often
+};
+
+/******************************************************************************************/
+////////////////////////////////////////////////////////////////////////////////////////////
+/******************************************************************************************/
+/**
+ * Appends results to a result file. store() may be called by several I/O threads at once;
+ * it only copies the result into the pending batch. The batch is handed over to the writer
+ * thread by swapping buffers, so results may be stored while the previous batch is written.
+ */
+class result_sink {
+public:
+    explicit result_sink(const result_sink_settings &settings)
+        : m_settings(settings)
+        , m_stream(settings.path, std::ios::out | std::ios::binary | std::ios::trunc)
+    {
+        if (!m_stream) {
+            throw std::runtime_error("result_sink: Could not open " + settings.path + " for writing");
+        }
+
+        m_stream.write(RESULTFILEMAGIC, RESULTFILEMAGICLENGTH);
+
+        // Avoid re-allocations in the common case
+        m_pending.reserve(2 * m_settings.batch_size);
+        m_writing.reserve(2 * m_settings.batch_size);
+
+        m_start = std::chrono::steady_clock::now();
+        m_writer_thread = std::thread([this]() { this->write_batches(); });
+    }
+
+    result_sink(const result_sink &) = delete;
+    result_sink &operator=(const result_sink &) = delete;
+
+    ~result_sink() {
+        try {
+            close();
+        } catch (...) {
+            // Destructors must not throw
+        }
+    }
+
+    /** @brief Queues a result for writing. Returns false if the result had to be dropped */
+    bool store(const char *data, std::size_t size) {
+        auto le_size = boost::endian::native_to_little(std::uint64_t(size));
+        bool wake_writer = false;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            if (m_pending.size() + m_n_writing_bytes + sizeof(le_size) + size > m_settings.max_pending) {
+                m_n_dropped++;
+                return false;
+            }
+
+            const auto *size_ptr = reinterpret_cast<const char *>(&le_size);
+            m_pending.insert(m_pending.end(), size_ptr, size_ptr + sizeof(le_size));
+            m_pending.insert(m_pending.end(), data, data + size);
+            m_n_stored++;
+
+            auto n_pending = m_pending.size() + m_n_writing_bytes;
+            if (n_pending > m_max_pending_seen) m_max_pending_seen = n_pending;
+
+            wake_writer = m_pending.size() >= m_settings.batch_size;
+        }
+
+        if (wake_writer) m_cv.notify_one();
+        return true;
+    }
+
+    /** @brief Writes all pending results and closes the file. Called by the destructor, if needed */
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_stopped) return;
+            m_stopped = true;
+        }
+
+        m_cv.notify_one();
+        m_writer_thread.join();
+        m_stream.close();
+        m_elapsed = std::chrono::steady_clock::now() - m_start;
+
+        if (m_write_failed) {
+            throw std::runtime_error("result_sink::close(): Could not write to " + m_settings.path);
+        }
+    }
+
+    /** @brief The number of results accepted by store() */
+    std::size_t get_n_stored() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_n_stored;
+    }
+
+    /** @brief The number of results that were dropped, as the disk could not keep up */
+    std::size_t get_n_dropped() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_n_dropped;
+    }
+
+    /** @brief The number of bytes written to disk (excluding the file header) */
+    std::size_t get_n_bytes_written() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_n_bytes_written;
+    }
+
+    /** @brief The number of batches written to disk */
+    std::size_t get_n_batches() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_n_batches;
+    }
+
+    /** @brief The largest amount of memory (in bytes) occupied by results waiting for the disk */
+    std::size_t get_max_pending() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_max_pending_seen;
+    }
+
+    /** @brief The time (in seconds) the writer thread spent writing */
+    double get_write_time() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return std::chrono::duration<double>(m_write_time).count();
+    }
+
+    /** @brief The time (in seconds) between construction and close() */
+    double get_elapsed_time() const {
+        return std::chrono::duration<double>(m_elapsed).count();
+    }
+
+private:
+    // The main loop of the writer thread
+    void write_batches() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        while (true) {
+            m_cv.wait_for(lock, m_settings.flush_interval, [this]() {
+                return m_stopped || m_pending.size() >= m_settings.batch_size;
+            });
+
+            if (m_pending.empty()) {
+                if (m_stopped) break;
+                continue;
+            }
+
+            // Hand the pending batch over to this thread, I/O threads continue with an empty buffer
+            m_pending.swap(m_writing);
+            m_n_writing_bytes = m_writing.size();
+            lock.unlock();
+
+            auto start = std::chrono::steady_clock::now();
+            m_stream.write(m_writing.data(), static_cast<std::streamsize>(m_writing.size()));
+            m_stream.flush();
+            auto write_time = std::chrono::steady_clock::now() - start;
+
+            lock.lock();
+            if (!m_stream) m_write_failed = true;
+            m_write_time += write_time;
+            m_n_bytes_written += m_writing.size();
+            m_n_batches++;
+            m_n_writing_bytes = 0;
+            m_writing.clear();
+        }
+    }
+
+    result_sink_settings m_settings;
+    std::ofstream m_stream; ///< Only touched by the writer thread once it has been started
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::thread m_writer_thread;
+
+    std::vector<char> m_pending; ///< Filled by store()
+    std::vector<char> m_writing; ///< The batch currently written by the writer thread
+    std::size_t m_n_writing_bytes = 0;
+    bool m_stopped = false;
+    bool m_write_failed = false;
+
+    std::size_t m_n_stored = 0;
+    std::size_t m_n_dropped = 0;
+    std::size_t m_n_bytes_written = 0;
+    std::size_t m_n_batches = 0;
+    std::size_t m_max_pending_seen = 0;
+    std::chrono::steady_clock::duration m_write_time{0};
+    std::chrono::steady_clock::time_point m_start;
+    std::chrono::steady_clock::duration m_elapsed{0};
+};
+
+/******************************************************************************************/
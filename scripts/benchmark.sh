@@ -0,0 +1,114 @@
+#!/usr/bin/env bash
+
+####################################################################
+# The following license applies to the script in this file:
+#
+####################################################################
+#
+# Boost Software License - Version 1.0 - August 17th, 2003
+#
+# Permission is hereby granted, free of charge, to any person or organization
+# obtaining a copy of the software and accompanying documentation covered by
+# this license (the "Software") to use, reproduce, display, distribute,
+# execute, and transmit the Software, and to prepare derivative works of the
+# Software, and to permit third-parties to whom the Software is furnished to
+# do so, all subject to the following:
+#
+# The copyright notices in the Software and this entire statement, including
+# the above license grant, this restriction and the following disclaimer,
+# must be included in all copies of the Software, in whole or in part, and
+# all derivative works of the Software, unless such copies or derivative
+# works are solely in the form of machine-executable object code generated by
+# a source language processor.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+# SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+# FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+# ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+# DEALINGS IN THE SOFTWARE.
+#
+####################################################################
+#
+# Author: Dr. Rüdiger Berlich of Gemfony scientific UG (haftungsbeschraenkt)
+# See http://www.gemfony.eu for further information.
+#
+####################################################################
+# This script runs a series of short, local measurements with a given
+# Estray executable: for each transport and message size, a server and a
+# number of clients are started on this machine, and the steady-state
+# throughput reported by the server is collected into a table. Running it
+# with differently configured builds, using different labels, allows to
+# compare them. Message sizes > 0 use the transport-only echo mode, size 0
+# uses the normal container payload.
+####################################################################
+
+# Check the number of command line arguments (should be 4 or 5)
+if [ $# -lt 4 ] || [ $# -gt 5 ]; then
+    echo "Usage: ./benchmark.sh <program name> <label> <number of clients> <duration in s> [<port>]"
+    exit 1
+fi
+
+# Read in the command line arguments
+PROGNAME=$1
+LABEL=$2
+NCLIENTS=$3
+DURATION=$4
+PORT=${5:-10000}
+
+# The transports and message sizes to be measured
+TRANSPORTS="0 1 2"
+MESSAGESIZES="0 1024 65536 1048576"
+SOCKETPATH=/tmp/estray_benchmark.sock
+
+# Check that the program exists
+if [ ! -e ${PROGNAME} ]; then
+    echo "Error: Program file ${PROGNAME} does not exist."
+    exit
+fi
+
+# Check that the desired number of clients and the duration are integral and > 0
+if [ ! $(echo "${NCLIENTS}" | grep -E "^[1-9][0-9]*$") ]; then
+    echo "Error: Number of clients \"${NCLIENTS}\" is not a valid integer > 0. Leaving."
+    exit
+fi
+if [ ! $(echo "${DURATION}" | grep -E "^[1-9][0-9]*$") ]; then
+    echo "Error: Duration \"${DURATION}\" is not a valid integer > 0. Leaving."
+    exit
+fi
+
+# Create an output directory
+if [ ! -d ./output ]; then
+    mkdir ./output
+fi
+
+echo "# label transport message_size mean[packages/s] min[packages/s] max[packages/s] std_dev"
+
+for TRANSPORT in ${TRANSPORTS}; do
+    for SIZE in ${MESSAGESIZES}; do
+        # Each measurement uses its own port, so lingering connections of the last one do not interfere
+        PORT=$((PORT + 1))
+        SERVERLOG=./output/benchmark_${LABEL}_${TRANSPORT}_${SIZE}_server
+
+        # Start the server. Warm-up and cool-down phases are excluded from the statistics
+        ./${PROGNAME} --transport=${TRANSPORT} --echo_size=${SIZE} --port=${PORT} --socket_path=${SOCKETPATH} \
+            --max_n_served=0 --max_duration=${DURATION} --warm_up_time=1 --cool_down_time=1 >& ${SERVERLOG} &
+        SERVERPID=$!
+        sleep 1
+
+        # Start the clients
+        for i in $(seq 1 ${NCLIENTS}); do
+            (./${PROGNAME} --client --transport=${TRANSPORT} --echo_size=${SIZE} --port=${PORT} \
+                --socket_path=${SOCKETPATH} >& ./output/benchmark_${LABEL}_${TRANSPORT}_${SIZE}_client_$i) &
+        done
+
+        wait ${SERVERPID}
+        sleep 1
+
+        # Extract the steady-state figures from the server output
+        grep "steady-state" ${SERVERLOG} \
+            | sed -E 's/.*mean = ([0-9.e+]+).*min = ([0-9.e+]+).*max = ([0-9.e+]+).*std\. dev\. = ([0-9.e+]+).*/\1 \2 \3 \4/' \
+            | awk -v l=${LABEL} -v t=${TRANSPORT} -v s=${SIZE} '{ print l, t, s, $0 }'
+    done
+done
@@ -0,0 +1,342 @@
+/**
+ * @file spill.hpp
+ */
+
+/*
+ * The following license applies to the code in this file:
+ *
+ * **************************************************************************
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * **************************************************************************
+ *
+ * Author: Dr. Rüdiger Berlich of Gemfony scientific UG (haftungsbeschraenkt)
+ * See http://www.gemfony.eu for further information.
+ *
+ * This code is based on the Beast Websocket library by Vinnie Falco.
+ */
+
+#pragma once
+
+/******************************************************************************************/
+/*
+ * A disk-backed second level of the payload queue. Producers that find the in-memory queue
+ * full append their payloads to segment files instead of waiting, and a refill thread reads
+ * them back into the in-memory queue whenever it has room. This way, payloads produced while
+ * clients are slow are kept for later bursts of demand, while the memory held for them stays
+ * bounded. Records have the format of workload files (an 8-byte little-endian size followed
+ * by the output of to_binary()). Segments are read back in the order they were written and
+ * removed once they have been read.
+ */
+
+// Standard headers go here
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+#include <unistd.h>
+
+// Boost headers go here
+#include <boost/endian/conversion.hpp>
+#include <boost/filesystem.hpp>
+
+// Our own headers go here
+#include "payload.hpp"
+
+/******************************************************************************************/
+
+/** @brief The settings of the spill queue */
+struct spill_settings {
+    std::string directory; ///< Where segment files are created. Empty disables spilling
+    std::size_t max_bytes = std::size_t(4096) * 1024 * 1024; ///< The largest amount of payload data kept on disk
+    std::size_t segment_size = std::size_t(64) * 1024 * 1024; ///< Segments are closed for reading once they reach this size
+    std::size_t min_early_seal_size = std::size_t(1) * 1024 * 1024; ///< A reader that caught up may close smaller segments once they reach this size ...
+    double early_seal_idle_time = 0.1; ///< ... or once no payload was written to them for this many seconds
+};
+
+/******************************************************************************************/
+////////////////////////////////////////////////////////////////////////////////////////////
+/******************************************************************************************/
+/**
+ * Keeps payloads in segment files. push() may be called by several producers at once, while
+ * pop() must only be called by a single thread.
+ */
+class spill_queue {
+public:
+    //--------------------------------------------------------------------------
+
+    explicit spill_queue(spill_settings settings)
+        : m_settings(std::move(settings))
+    {
+        boost::system::error_code ec;
+        boost::filesystem::create_directories(m_settings.directory, ec);
+        if (!boost::filesystem::is_directory(m_settings.directory)) {
+            throw std::runtime_error("spill_queue: " + m_settings.directory + " is not a directory");
+        }
+    }
+
+    spill_queue(const spill_queue &) = delete;
+    spill_queue &operator=(const spill_queue &) = delete;
+
+    //--------------------------------------------------------------------------
+    // Payloads still on disk are discarded
+    ~spill_queue() {
+        boost::system::error_code ec;
+        m_read_stream.close();
+        if (!m_read_path.empty()) boost::filesystem::remove(m_read_path, ec);
+        for (const auto &segment: m_sealed) boost::filesystem::remove(segment.path, ec);
+        m_write_stream.close();
+        if (!m_write_path.empty()) boost::filesystem::remove(m_write_path, ec);
+    }
+
+    //--------------------------------------------------------------------------
+    /**
+     * Appends a payload to the current segment. Returns false if it would exceed the space
+     * granted on disk, or if it could not be written (e.g. because the disk is full). The
+     * payload remains owned by the caller.
+     */
+    bool push(const payload_base *payload_ptr) {
+        // Serialization happens outside of the lock
+        auto record = to_binary(payload_ptr);
+        auto size = boost::endian::native_to_little(std::uint64_t(record.size()));
+        auto record_size = sizeof(size) + record.size();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_bytes_on_disk + record_size > m_settings.max_bytes) return false;
+
+        if (m_write_path.empty()) {
+            m_write_path = segment_path(m_n_segments++);
+            m_write_stream.clear();
+            m_write_stream.open(m_write_path, std::ios::out | std::ios::binary | std::ios::trunc);
+            if (!m_write_stream) {
+                m_write_path.clear();
+                m_n_write_failures++;
+                return false;
+            }
+        }
+
+        m_write_stream.write(reinterpret_cast<const char *>(&size), sizeof(size));
+        m_write_stream.write(record.data(), static_cast<std::streamsize>(record.size()));
+        if (!m_write_stream) {
+            // Parts of the record may have been written. They are overwritten by the next record,
+            // or ignored by the reader, which only reads complete records.
+            m_write_stream.clear();
+            m_write_stream.seekp(static_cast<std::streamoff>(m_write_bytes));
+            m_n_write_failures++;
+            return false;
+        }
+
+        m_write_bytes += record_size;
+        m_write_records++;
+        m_bytes_on_disk += record_size;
+        m_max_bytes_on_disk = std::max(m_max_bytes_on_disk, m_bytes_on_disk);
+        m_last_write = std::chrono::steady_clock::now();
+        m_n_pushed++;
+
+        if (m_write_bytes >= m_settings.segment_size) seal();
+        return true;
+    }
+
+    //--------------------------------------------------------------------------
+    /**
+     * Reads the oldest payload back. Returns nullptr if there is none. The current segment is
+     * closed early if there is nothing else to read, provided it has reached a minimum size or
+     * producers have stopped writing to it for a while. Otherwise, a reader that keeps up with
+     * the producers would create a segment file for every record. A segment that cannot be
+     * read is dropped with the payloads left in it, so the caller may keep serving from memory.
+     */
+    payload_base *pop() {
+        while (true) {
+            if (0 == m_read_records && !open_next_segment()) return nullptr;
+
+            std::uint64_t size = 0;
+            m_read_stream.read(reinterpret_cast<char *>(&size), sizeof(size));
+            size = boost::endian::little_to_native(size);
+            if (!m_read_stream || size > m_read_bytes) { // A corrupt size must not be allocated
+                drop_read_segment();
+                continue;
+            }
+
+            m_read_record.resize(size);
+            m_read_stream.read(m_read_record.data(), static_cast<std::streamsize>(size));
+            if (!m_read_stream) {
+                drop_read_segment();
+                continue;
+            }
+
+            payload_base *plb_ptr = nullptr;
+            try {
+                plb_ptr = from_binary(m_read_record);
+            } catch (const std::exception &) {
+                drop_read_segment();
+                continue;
+            }
+            m_read_records--;
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_n_popped++;
+            }
+
+            return plb_ptr;
+        }
+    }
+
+    //--------------------------------------------------------------------------
+
+    [[nodiscard]] std::size_t get_n_pushed() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_n_pushed;
+    }
+
+    [[nodiscard]] std::size_t get_n_popped() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_n_popped;
+    }
+
+    [[nodiscard]] std::size_t get_max_bytes_on_disk() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_max_bytes_on_disk;
+    }
+
+    [[nodiscard]] std::size_t get_n_write_failures() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_n_write_failures;
+    }
+
+    [[nodiscard]] std::size_t get_n_read_failures() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_n_read_failures;
+    }
+
+private:
+    //--------------------------------------------------------------------------
+
+    struct segment {
+        std::string path;
+        std::size_t n_records = 0;
+        std::size_t n_bytes = 0;
+    };
+
+    std::string segment_path(std::size_t n) const {
+        return (boost::filesystem::path(m_settings.directory)
+                / ("estray_spill_" + std::to_string(::getpid()) + "_" + std::to_string(n) + ".seg")).string();
+    }
+
+    // Closes the current segment for writing, so it may be read. Needs to be called with the mutex held.
+    void seal() {
+        m_write_stream.close();
+        m_sealed.push_back(segment{m_write_path, m_write_records, m_write_bytes});
+        m_write_path.clear();
+        m_write_bytes = 0;
+        m_write_records = 0;
+    }
+
+    // Whether the segment being written may be read before it is full. Needs to be called with the mutex held.
+    bool may_seal_early() const {
+        if (m_write_bytes >= m_settings.min_early_seal_size) return true;
+        return std::chrono::steady_clock::now() - m_last_write
+               >= std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(m_settings.early_seal_idle_time));
+    }
+
+    // Gives up on the remaining records of the segment being read. It is removed by the next call to open_next_segment().
+    void drop_read_segment() {
+        std::cout << "spill_queue: Could not read from " << m_read_path << ", dropping " << m_read_records << " payloads" << std::endl;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_n_read_failures += m_read_records;
+        }
+        m_read_records = 0;
+    }
+
+    // Removes the segment just read and opens the oldest remaining one. Returns false if there is none.
+    bool open_next_segment() {
+        while (true) {
+            m_read_stream.close();
+            boost::system::error_code ec;
+            if (!m_read_path.empty()) boost::filesystem::remove(m_read_path, ec);
+            m_read_path.clear();
+
+            segment next;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_bytes_on_disk -= m_read_bytes;
+                m_read_bytes = 0;
+
+                if (m_sealed.empty() && m_write_records > 0 && may_seal_early()) seal();
+                if (m_sealed.empty()) return false;
+
+                next = m_sealed.front();
+                m_sealed.pop_front();
+            }
+
+            m_read_stream.clear();
+            m_read_stream.open(next.path, std::ios::in | std::ios::binary);
+            m_read_path = next.path;
+            m_read_records = next.n_records;
+            m_read_bytes = next.n_bytes;
+            if (m_read_stream) return true;
+
+            // Try the next segment
+            drop_read_segment();
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    // Data
+
+    const spill_settings m_settings;
+    mutable std::mutex m_mutex; ///< Protects everything but the reading side
+
+    std::ofstream m_write_stream;
+    std::string m_write_path; ///< The segment being written, empty if there is none
+    std::size_t m_write_bytes = 0;
+    std::size_t m_write_records = 0;
+    std::chrono::steady_clock::time_point m_last_write; ///< When the last record was written
+    std::deque<segment> m_sealed; ///< Segments waiting to be read, oldest first
+    std::size_t m_n_segments = 0;
+
+    std::ifstream m_read_stream;
+    std::string m_read_path; ///< The segment being read, empty if there is none
+    std::size_t m_read_records = 0; ///< The records left in the segment being read
+    std::size_t m_read_bytes = 0; ///< The size of the segment being read, freed once it is removed
+    std::string m_read_record;
+
+    std::size_t m_bytes_on_disk = 0;
+    std::size_t m_max_bytes_on_disk = 0;
+    std::size_t m_n_pushed = 0;
+    std::size_t m_n_popped = 0;
+    std::size_t m_n_write_failures = 0;
+    std::size_t m_n_read_failures = 0; ///< Payloads lost because their segment could not be read
+};
+
+/******************************************************************************************/
@@ -0,0 +1,201 @@
+/**
+ * @file spool.hpp
+ */
+
+/*
+ * The following license applies to the code in this file:
+ *
+ * **************************************************************************
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * **************************************************************************
+ *
+ * Author: Dr. Rüdiger Berlich of Gemfony scientific UG (haftungsbeschraenkt)
+ * See http://www.gemfony.eu for further information.
+ *
+ * This code is based on the Beast Websocket library by Vinnie Falco.
+ */
+
+#pragma once
+
+/******************************************************************************************/
+/*
+ * Spools hold pre-serialized work items, i.e. complete messages exactly as they are sent to
+ * clients (including flat containers and compression, if these were enabled when the spool
+ * was created). A spool file starts with SPOOLFILEMAGIC, followed by one entry per message:
+ * its size as an 8-byte little-endian number and the message itself. The server maps the
+ * file into memory and hands out entries straight from the mapping, so serving a work item
+ * involves neither producers nor serialization nor copies.
+ */
+
+// Standard headers go here
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+// Boost headers go here
+#include <boost/asio/buffer.hpp>
+#include <boost/endian/conversion.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+// Our own headers go here
+// Nothing
+
+/******************************************************************************************/
+
+const char SPOOLFILEMAGIC[] = "#ESTSPL#";
+const std::size_t SPOOLFILEMAGICLENGTH = sizeof(SPOOLFILEMAGIC) - 1;
+
+/******************************************************************************************/
+////////////////////////////////////////////////////////////////////////////////////////////
+/******************************************************************************************/
+/**
+ * Writes messages to a new spool file. Not thread-safe.
+ */
+class spool_writer {
+public:
+    explicit spool_writer(const std::string &path)
+        : m_stream(path, std::ios::out | std::ios::binary | std::ios::trunc)
+    {
+        if (!m_stream) {
+            throw std::runtime_error("spool_writer: Could not open " + path + " for writing");
+        }
+
+        m_stream.write(SPOOLFILEMAGIC, SPOOLFILEMAGICLENGTH);
+    }
+
+    spool_writer(const spool_writer &) = delete;
+    spool_writer &operator=(const spool_writer &) = delete;
+
+    void write(const char *data, std::size_t size) {
+        auto header = boost::endian::native_to_little(std::uint64_t(size));
+        m_stream.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        m_stream.write(data, static_cast<std::streamsize>(size));
+        if (!m_stream) {
+            throw std::runtime_error("spool_writer::write(): Could not write entry");
+        }
+        m_n_entries++;
+    }
+
+    std::size_t get_n_entries() const noexcept {
+        return m_n_entries;
+    }
+
+private:
+    std::ofstream m_stream;
+    std::size_t m_n_entries = 0;
+};
+
+/******************************************************************************************/
+////////////////////////////////////////////////////////////////////////////////////////////
+/******************************************************************************************/
+/**
+ * Hands out the entries of a memory-mapped spool file, starting over at the beginning once
+ * the end has been reached. next() may be called from any number of threads; the position in
+ * the file is advanced through a compare-and-swap loop. Buffers remain valid for the lifetime
+ * of the reader.
+ */
+class spool_reader {
+public:
+    explicit spool_reader(const std::string &path) {
+        try {
+            m_mapping = boost::interprocess::file_mapping(path.c_str(), boost::interprocess::read_only);
+            m_region = boost::interprocess::mapped_region(m_mapping, boost::interprocess::read_only);
+        } catch (const boost::interprocess::interprocess_exception &e) {
+            throw std::runtime_error("spool_reader: Could not map " + path + ": " + e.what());
+        }
+
+        m_data = static_cast<const char *>(m_region.get_address());
+        m_size = m_region.get_size();
+
+        if (m_size < SPOOLFILEMAGICLENGTH || 0 != std::memcmp(m_data, SPOOLFILEMAGIC, SPOOLFILEMAGICLENGTH)) {
+            throw std::runtime_error("spool_reader: " + path + " is not a spool file");
+        }
+
+        if (m_size == SPOOLFILEMAGICLENGTH) {
+            throw std::runtime_error("spool_reader: " + path + " does not contain any entries");
+        }
+
+        // Entries are mostly read in order
+        m_region.advise(boost::interprocess::mapped_region::advice_sequential);
+    }
+
+    spool_reader(const spool_reader &) = delete;
+    spool_reader &operator=(const spool_reader &) = delete;
+
+    /** @brief Retrieves the next entry. Throws if the file is corrupt */
+    boost::asio::const_buffer next() {
+        std::size_t position = m_position.load(std::memory_order_relaxed);
+
+        while (true) {
+            if (position == m_size) { // Start over
+                if (m_position.compare_exchange_weak(position, SPOOLFILEMAGICLENGTH, std::memory_order_relaxed)) {
+                    m_n_passes++;
+                    position = SPOOLFILEMAGICLENGTH;
+                }
+                continue;
+            }
+
+            std::uint64_t entry_size = 0;
+            if (m_size - position < sizeof(entry_size)) {
+                throw std::runtime_error("spool_reader::next(): Truncated entry header");
+            }
+            std::memcpy(&entry_size, m_data + position, sizeof(entry_size));
+            entry_size = boost::endian::little_to_native(entry_size);
+
+            if (entry_size > m_size - position - sizeof(entry_size)) {
+                throw std::runtime_error("spool_reader::next(): Truncated entry");
+            }
+
+            std::size_t next_position = position + sizeof(entry_size) + entry_size;
+            if (m_position.compare_exchange_weak(position, next_position, std::memory_order_relaxed)) {
+                return boost::asio::const_buffer(m_data + position + sizeof(entry_size), entry_size);
+            }
+            // position now holds the current value, so we simply try again
+        }
+    }
+
+    /** @brief The number of times the reader had to start over */
+    std::size_t get_n_passes() const noexcept {
+        return m_n_passes.load();
+    }
+
+private:
+    boost::interprocess::file_mapping m_mapping;
+    boost::interprocess::mapped_region m_region;
+
+    const char *m_data = nullptr;
+    std::size_t m_size = 0;
+
+    std::atomic<std::size_t> m_position{SPOOLFILEMAGICLENGTH}; ///< The offset of the next entry
+    std::atomic<std::size_t> m_n_passes{0};
+};
+
+/******************************************************************************************/
@@ -0,0 +1,274 @@
+/**
+ * @file submitter.hpp
+ */
+
+/*
+ * The following license applies to the code in this file:
+ *
+ * **************************************************************************
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * **************************************************************************
+ *
+ * Author: Dr. Rüdiger Berlich of Gemfony scientific UG (haftungsbeschraenkt)
+ * See http://www.gemfony.eu for further information.
+ *
+ * This code is based on the Beast Websocket library by Vinnie Falco.
+ */
+
+#pragma once
+
+/******************************************************************************************/
+/*
+ * A simple submitter for broker mode. It connects to the broker through a websocket, hands in
+ * a job of container or sleep payloads in batches, and collects and checks the results. Its
+ * main purpose is to demonstrate and measure the submission protocol (see broker_header):
+ * Payloads the broker could not take (because its queue was full, or too many results were
+ * waiting to be collected) are sent again after the next round of collection.
+ */
+
+// Standard headers go here
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+// Boost headers go here
+#include <boost/asio/connect.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+
+// Our own headers go here
+#include "misc.hpp"
+#include "payload.hpp"
+#include "compression.hpp"
+
+/******************************************************************************************/
+
+/** @brief The job handed to the broker by a job_submitter */
+struct submission_settings {
+    std::size_t n_payloads = 1000; ///< The size of the job
+    std::size_t batch_size = 100; ///< The most payloads sent with a single SUBMIT message
+    std::uint64_t job_id = 0; ///< Adds the payloads to an existing job, if set
+    std::size_t retry_ms = 10; ///< The pause before asking again, if the broker had nothing for us
+};
+
+/******************************************************************************************/
+////////////////////////////////////////////////////////////////////////////////////////////
+/******************************************************************************************/
+
+class job_submitter {
+public:
+    //--------------------------------------------------------------------------
+
+    job_submitter(
+            std::string address
+            , unsigned short port
+            , const submission_settings &submission
+            , const compression_settings &compression
+    )
+            : m_address(std::move(address))
+            , m_port(port)
+            , m_submission(submission)
+            , m_compressor(compression)
+    { /* nothing */ }
+
+    job_submitter(const job_submitter &) = delete;
+    job_submitter &operator=(const job_submitter &) = delete;
+
+    //--------------------------------------------------------------------------
+    /**
+     * Submits the job and collects its results. The factory creates the payload with the given
+     * index. Returns the number of verified results.
+     */
+    template<typename factory_t>
+    std::size_t run(factory_t &&make_payload) {
+        namespace net = boost::asio;
+        namespace websocket = boost::beast::websocket;
+
+        net::ip::tcp::resolver resolver(m_io_context);
+        auto endpoint = boost::beast::get_lowest_layer(m_ws).connect(resolver.resolve(m_address, std::to_string(m_port)));
+        set_transfer_mode(m_ws);
+        m_ws.handshake(m_address + ":" + std::to_string(endpoint.port()), "/");
+
+        auto start = std::chrono::steady_clock::now();
+        std::deque<std::string> pending; // Serialized payloads not yet accepted by the broker
+        std::size_t n_created = 0;
+        std::size_t n_accepted = 0;
+        std::size_t n_batches = 0;
+        std::size_t n_rejected = 0;
+        m_job_id = m_submission.job_id;
+
+        while (n_accepted < m_submission.n_payloads) {
+            while (pending.size() < m_submission.batch_size && n_created < m_submission.n_payloads) {
+                std::unique_ptr<payload_base> payload_ptr(make_payload(n_created++));
+                pending.push_back(to_binary(payload_ptr.get()));
+            }
+
+            broker_header request;
+            request.command = payload_command::SUBMIT;
+            request.job_id = m_job_id;
+            request.n_records = std::min(pending.size(), m_submission.batch_size);
+
+            std::string body;
+            for (std::size_t i = 0; i < request.n_records; i++) append_broker_record(body, pending[i].data(), pending[i].size());
+
+            auto answer = exchange(request, body);
+            if (payload_command::ACCEPTED != answer.command) {
+                throw std::runtime_error("job_submitter::run(): Expected ACCEPTED, got " + boost::lexical_cast<std::string>(answer.command));
+            }
+
+            m_job_id = answer.job_id;
+            n_batches++;
+            n_accepted += answer.n_records;
+            n_rejected += request.n_records - answer.n_records;
+            for (std::size_t i = 0; i < answer.n_records; i++) pending.pop_front();
+
+            // Results make room for further payloads. If the broker took nothing, we give it time.
+            auto n_collected = collect();
+            if (0 == answer.n_records && 0 == n_collected) std::this_thread::sleep_for(std::chrono::milliseconds(m_submission.retry_ms));
+        }
+
+        auto submitted = std::chrono::steady_clock::now();
+        while (m_n_collected < n_accepted) {
+            if (0 == collect()) std::this_thread::sleep_for(std::chrono::milliseconds(m_submission.retry_ms));
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        boost::beast::error_code ec;
+        m_ws.close(websocket::close_code::normal, ec);
+
+        auto total = std::chrono::duration<double>(end - start).count();
+        std::cout
+                << "job_submitter: Job " << m_job_id << ": Submitted " << n_accepted << " payloads in " << n_batches
+                << " batches within " << std::chrono::duration<double>(submitted - start).count() << " s ("
+                << n_rejected << " were sent again). Collected " << m_n_collected << " results (" << m_n_verified
+                << " verified) after " << total << " s, i.e. " << double(m_n_collected) / total << " results/s" << std::endl;
+
+        return m_n_verified;
+    }
+
+private:
+    //--------------------------------------------------------------------------
+    // Sends a request and returns the header of the answer. Its body remains in m_in_buffer at m_body_offset.
+    broker_header exchange(broker_header request, const std::string &body) {
+        m_out_buffer.consume(m_out_buffer.size());
+        boost::beast::ostream(m_out_buffer) << broker_header_string(request) << body;
+        compress_buffer(m_compressor, m_out_buffer, m_scratch_buffer);
+        m_ws.write(m_out_buffer.data());
+
+        m_in_buffer.consume(m_in_buffer.size());
+        m_ws.read(m_in_buffer);
+        compression_settings used;
+        decompress_buffer(m_compressor, m_in_buffer, m_scratch_buffer, used);
+
+        auto in_data = m_in_buffer.data();
+        const auto *data = static_cast<const char *>(in_data.data());
+        broker_header answer;
+        if (!parse_broker_header(data, in_data.size(), answer, m_body_offset)) {
+            payload_command command = payload_command::NONE;
+            if (parse_control_frame(data, in_data.size(), command) && payload_command::TERMINATE == command) {
+                throw std::runtime_error("job_submitter: The broker asked us to terminate");
+            }
+            throw std::runtime_error("job_submitter: Got an invalid answer from the broker");
+        }
+
+        if (payload_command::REJECTED == answer.command) {
+            throw std::runtime_error("job_submitter: The broker rejected our request: " + std::string(data + m_body_offset, data + in_data.size()));
+        }
+
+        return answer;
+    }
+
+    //--------------------------------------------------------------------------
+    // Fetches and checks the results that have arrived so far. Returns their number.
+    std::size_t collect() {
+        broker_header request;
+        request.command = payload_command::COLLECT;
+        request.job_id = m_job_id;
+
+        auto answer = exchange(request, std::string());
+        if (payload_command::RESULTS != answer.command) {
+            throw std::runtime_error("job_submitter::collect(): Expected RESULTS, got " + boost::lexical_cast<std::string>(answer.command));
+        }
+
+        auto in_data = m_in_buffer.data();
+        auto *data = static_cast<char *>(in_data.data());
+        const char *record = nullptr;
+        std::size_t record_size = 0;
+        std::size_t n_records = 0;
+        while (next_broker_record(data, in_data.size(), m_body_offset, record, record_size)) {
+            // Flat containers are checked in place
+            if (verify(data + (record - data), record_size)) m_n_verified++;
+            n_records++;
+        }
+
+        m_n_collected += n_records;
+        return n_records;
+    }
+
+    //--------------------------------------------------------------------------
+    // Results are handed out as the clients returned them, i.e. as flat containers or command containers
+    bool verify(char *data, std::size_t size) {
+        if (flat_container_view container(data, size); container.valid()) {
+            return payload_command::RESULT == container.get_command() && container.is_sorted();
+        }
+
+        command_container result{payload_command::NONE};
+        result.from_string(std::string(data, size));
+        return payload_command::RESULT == result.get_command() && result.is_processed();
+    }
+
+    //--------------------------------------------------------------------------
+    // Data
+
+    std::string m_address;
+    unsigned short m_port;
+    const submission_settings m_submission;
+
+    boost::asio::io_context m_io_context;
+    boost::beast::websocket::stream<boost::beast::tcp_stream> m_ws{m_io_context};
+    message_compressor m_compressor;
+
+    boost::beast::flat_buffer m_out_buffer;
+    boost::beast::flat_buffer m_in_buffer;
+    boost::beast::flat_buffer m_scratch_buffer;
+    std::size_t m_body_offset = 0; ///< Where the body of the last answer starts in m_in_buffer
+
+    std::uint64_t m_job_id = 0;
+    std::size_t m_n_collected = 0;
+    std::size_t m_n_verified = 0;
+};
+
+/******************************************************************************************/
@@ -0,0 +1,845 @@
+/**
+ * @file transport.hpp
+ */
+
+/*
+ * The following license applies to the code in this file:
+ *
+ * **************************************************************************
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * **************************************************************************
+ *
+ * Author: Dr. Rüdiger Berlich of Gemfony scientific UG (haftungsbeschraenkt)
+ * See http://www.gemfony.eu for further information.
+ *
+ * This code is based on the Beast Websocket library by Vinnie Falco.
+ */
+
+#pragma once
+
+// Standard headers go here
+#include <string>
+#include <memory>
+#include <utility>
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <array>
+#include <type_traits>
+#include <optional>
+
+// System headers go here
+#include <unistd.h>
+
+// Boost headers go here
+#include <boost/asio.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#include <boost/beast/websocket/rfc6455.hpp>
+#include <boost/endian/conversion.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+// Our own headers go here
+#include "misc.hpp"
+#include "buffer_pool.hpp"
+
+/******************************************************************************************/
+////////////////////////////////////////////////////////////////////////////////////////////
+/******************************************************************************************/
+
+namespace beast = boost::beast;         // from <boost/beast.hpp>
+namespace http = beast::http;           // from <boost/beast/http.hpp>
+namespace websocket = beast::websocket; // from <boost/beast/websocket.hpp>
+namespace net = boost::asio;            // from <boost/asio.hpp>
+
+using tcp = net::ip::tcp;       // from <boost/asio/ip/tcp.hpp>
+using local_stream = net::local::stream_protocol; // from <boost/asio/local/stream_protocol.hpp>
+
+/** @brief The largest message accepted by the length-prefixed transports (protects against corrupt headers) */
+const std::uint64_t MAXFRAMEDMESSAGESIZE = std::uint64_t(1) << 30;
+
+/** @brief The buffer type used for complete messages by sessions and clients. Memory comes from the buffer pool */
+using message_buffer = beast::basic_flat_buffer<pooled_buffer_allocator<char>>;
+
+/******************************************************************************************/
+////////////////////////////////////////////////////////////////////////////////////////////
+/******************************************************************************************/
+/**
+ * Resolves a host name and connects a tcp-based stream to the first reachable endpoint.
+ * Used by the transports through net::async_compose.
+ */
+template<typename stream_t>
+struct tcp_connect_op {
+    stream_t &m_stream;
+    tcp::resolver &m_resolver;
+    std::string m_host;
+    std::string m_port;
+
+    template<typename self_t>
+    void operator()(self_t &self) {
+        m_resolver.async_resolve(m_host, m_port, std::move(self));
+    }
+
+    template<typename self_t>
+    void operator()(self_t &self, beast::error_code ec, const tcp::resolver::results_type &results) {
+        if (ec) return self.complete(ec);
+
+        // Set the timeout for the operation
+        m_stream.expires_after(std::chrono::seconds(30));
+
+        // Make the connection on the IP address we get from a lookup
+        m_stream.async_connect(results, std::move(self));
+    }
+
+    template<typename self_t>
+    void operator()(self_t &self, beast::error_code ec, const tcp::endpoint & /* ep */) {
+        self.complete(ec);
+    }
+};
+
+/******************************************************************************************/
+////////////////////////////////////////////////////////////////////////////////////////////
+/******************************************************************************************/
+/**
+ * The transports wrap the stream used by server sessions and clients. They provide a common,
+ * message-oriented interface (handshakes, reading a complete message into a flat_buffer, writing
+ * a complete message from a buffer sequence and closing), so that the communication logic does
+ * not need to know whether messages are transferred through websocket frames or otherwise.
+ * All asynchronous functions accept arbitrary completion tokens.
+ */
+class websocket_transport {
+public:
+    using protocol_type = tcp;
+    using stream_type = websocket::stream<beast::tcp_stream>;
+    using executor_type = stream_type::executor_type;
+
+    //--------------------------------------------------------------------------
+    // Used on the server side, where we take ownership of an accepted socket
+    explicit websocket_transport(tcp::socket &&socket)
+        : m_ws(std::move(socket))
+    {
+        configure();
+    }
+
+    // Used on the client side, where the connection is yet to be made
+    template<typename executor_t>
+    explicit websocket_transport(const executor_t &executor)
+        : m_ws(executor)
+        , m_resolver(executor)
+    {
+        configure();
+    }
+
+    //--------------------------------------------------------------------------
+    // Process-wide settings. Need to be made before the first transport is created
+
+    // Enables the permessage-deflate extension. Only used if both sides enable it
+    static void set_permessage_deflate(bool enabled) {
+        permessage_deflate_enabled() = enabled;
+    }
+
+    //--------------------------------------------------------------------------
+
+    executor_type get_executor() {
+        return m_ws.get_executor();
+    }
+
+    //--------------------------------------------------------------------------
+    // Looks up the host and establishes the tcp connection (client side)
+    template<typename token_t>
+    auto async_connect(const std::string &host, unsigned short port, token_t &&token) {
+        return net::async_compose<token_t, void(beast::error_code)>(
+                tcp_connect_op<beast::tcp_stream>{beast::get_lowest_layer(m_ws), *m_resolver, host, std::to_string(port)}
+                , token
+                , m_ws
+        );
+    }
+
+    //--------------------------------------------------------------------------
+    // Accepts the websocket handshake (server side)
+    template<typename token_t>
+    auto async_accept(token_t &&token) {
+        // Set suggested timeout settings for the websocket
+        m_ws.set_option(
+                websocket::stream_base::timeout::suggested(
+                        beast::role_type::server));
+
+        // Set a decorator to change the Server of the handshake
+        m_ws.set_option(websocket::stream_base::decorator(
+                [](websocket::response_type &res) {
+                    res.set(http::field::server,
+                            std::string(BOOST_BEAST_VERSION_STRING) +
+                            " async_websocket_server_session");
+                }));
+
+        return m_ws.async_accept(std::forward<token_t>(token));
+    }
+
+    //--------------------------------------------------------------------------
+    // Performs the websocket handshake (client side)
+    template<typename token_t>
+    auto async_handshake(const std::string &host, token_t &&token) {
+        // Turn off the timeout on the tcp_stream, because
+        // the websocket stream has its own timeout system.
+        beast::get_lowest_layer(m_ws).expires_never();
+
+        // Set suggested timeout settings for the websocket
+        m_ws.set_option(
+                websocket::stream_base::timeout::suggested(
+                        beast::role_type::client));
+
+        // Set a decorator to change the User-Agent of the handshake
+        m_ws.set_option(websocket::stream_base::decorator(
+                [](websocket::request_type &req) {
+                    req.set(http::field::user_agent,
+                            std::string(BOOST_BEAST_VERSION_STRING) +
+                            " async_websocket_client ");
+                }));
+
+        return m_ws.async_handshake(host, "/", std::forward<token_t>(token));
+    }
+
+    //--------------------------------------------------------------------------
+    // Reads a complete message into the buffer
+    template<typename dynamic_buffer_t, typename token_t>
+    auto async_read(dynamic_buffer_t &buffer, token_t &&token) {
+        return m_ws.async_read(buffer, std::forward<token_t>(token));
+    }
+
+    //--------------------------------------------------------------------------
+    // Writes a complete message
+    template<typename const_buffers_t, typename token_t>
+    auto async_write(const const_buffers_t &buffers, token_t &&token) {
+        return m_ws.async_write(buffers, std::forward<token_t>(token));
+    }
+
+    //--------------------------------------------------------------------------
+
+    bool is_open() const {
+        return m_ws.is_open();
+    }
+
+    // Orderly shutdown of the connection. Throws on error
+    void close() {
+        m_ws.close(websocket::close_code::normal);
+    }
+
+    // Shutdown of the connection after a failure on our side
+    void close_on_error() {
+        m_ws.close(websocket::close_code::protocol_error);
+    }
+
+    // Closes the socket without a closing handshake. Pending operations complete with an error
+    void abort() {
+        beast::error_code ec;
+        beast::get_lowest_layer(m_ws).socket().close(ec);
+    }
+
+private:
+    //--------------------------------------------------------------------------
+
+    void configure() {
+        // Set the auto_fragment option, so control frames are delivered timely
+        m_ws.auto_fragment(true);
+        m_ws.write_buffer_bytes(16384);
+
+        // Set the transfer mode according to the defines in CMakeLists.txt
+        set_transfer_mode(m_ws);
+
+        if (permessage_deflate_enabled()) {
+            websocket::permessage_deflate pmd;
+            pmd.client_enable = true;
+            pmd.server_enable = true;
+            m_ws.set_option(pmd);
+        }
+    }
+
+    static bool &permessage_deflate_enabled() {
+        static bool enabled = false;
+        return enabled;
+    }
+
+    //--------------------------------------------------------------------------
+    // Data
+
+    stream_type m_ws;
+    std::optional<tcp::resolver> m_resolver; ///< Only needed on the client side
+};
+
+/******************************************************************************************/
+////////////////////////////////////////////////////////////////////////////////////////////
+/******************************************************************************************/
+/**
+ * Reads a message consisting of an 8-byte little-endian length header and the message body
+ * into a dynamic buffer. Used by framed_transport through net::async_compose.
+ */
+template<typename stream_t, typename dynamic_buffer_t>
+struct framed_read_op {
+    stream_t &m_stream;
+    std::uint64_t &m_header;
+    dynamic_buffer_t &m_buffer;
+
+    enum class state { starting, reading_header, reading_body } m_state = state::starting;
+
+    template<typename self_t>
+    void operator()(self_t &self, beast::error_code ec = {}, std::size_t bytes_transferred = 0) {
+        switch (m_state) {
+            case state::starting: {
+                m_state = state::reading_header;
+                net::async_read(m_stream, net::buffer(&m_header, sizeof(m_header)), std::move(self));
+            }
+                return;
+
+            case state::reading_header: {
+                if (ec) return self.complete(ec, 0);
+
+                auto message_size = boost::endian::little_to_native(m_header);
+                if (message_size > MAXFRAMEDMESSAGESIZE || message_size > m_buffer.max_size() - m_buffer.size()) {
+                    return self.complete(net::error::message_size, 0);
+                }
+
+                m_state = state::reading_body;
+                net::async_read(m_stream, m_buffer.prepare(message_size), std::move(self));
+            }
+                return;
+
+            case state::reading_body: {
+                if (!ec) m_buffer.commit(bytes_transferred);
+                self.complete(ec, bytes_transferred);
+            }
+                return;
+        }
+    }
+};
+
+/******************************************************************************************/
+/**
+ * A transport without websocket framing, masking or fragmentation. Each message is preceded
+ * by its length (8 bytes, little endian) on a plain stream. There is no handshake and there
+ * are no control frames, so this is meant for trusted, reliable networks only.
+ */
+template<typename protocol_t>
+class framed_transport {
+public:
+    using protocol_type = protocol_t;
+    using stream_type = beast::basic_stream<protocol_t>;
+    using executor_type = typename stream_type::executor_type;
+
+    //--------------------------------------------------------------------------
+    // Used on the server side, where we take ownership of an accepted socket
+    explicit framed_transport(typename protocol_t::socket &&socket)
+        : m_stream(std::move(socket))
+    {
+        configure();
+    }
+
+    // Used on the client side, where the connection is yet to be made
+    template<typename executor_t>
+    explicit framed_transport(const executor_t &executor)
+        : m_stream(executor)
+    {
+        if constexpr (std::is_same_v<protocol_t, tcp>) m_resolver.emplace(executor);
+    }
+
+    //--------------------------------------------------------------------------
+
+    executor_type get_executor() {
+        return m_stream.get_executor();
+    }
+
+    //--------------------------------------------------------------------------
+    // Establishes the connection (client side). For local transports, the
+    // address is the path of the socket and the port is ignored.
+    template<typename token_t>
+    auto async_connect(const std::string &address, unsigned short port, token_t &&token) {
+        if constexpr (std::is_same_v<protocol_t, tcp>) {
+            return net::async_compose<token_t, void(beast::error_code)>(
+                    tcp_connect_op<stream_type>{m_stream, *m_resolver, address, std::to_string(port)}
+                    , token
+                    , m_stream
+            );
+        } else {
+            // Set the timeout for the operation
+            m_stream.expires_after(std::chrono::seconds(30));
+
+            return m_stream.async_connect(typename protocol_t::endpoint(address), std::forward<token_t>(token));
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    // There is no handshake, so we complete immediately (server side)
+    template<typename token_t>
+    auto async_accept(token_t &&token) {
+        return net::async_initiate<token_t, void(beast::error_code)>(
+                [this](auto handler) {
+                    net::post(m_stream.get_executor(), beast::bind_front_handler(std::move(handler), beast::error_code{}));
+                }, token
+        );
+    }
+
+    //--------------------------------------------------------------------------
+    // There is no handshake, so we complete immediately (client side)
+    template<typename token_t>
+    auto async_handshake(const std::string & /* host */, token_t &&token) {
+        // Reads and writes will not time out. Dead peers are detected through errors on the socket.
+        m_stream.expires_never();
+        configure();
+
+        return async_accept(std::forward<token_t>(token));
+    }
+
+    //--------------------------------------------------------------------------
+    // Reads a complete message into the buffer
+    template<typename dynamic_buffer_t, typename token_t>
+    auto async_read(dynamic_buffer_t &buffer, token_t &&token) {
+        return net::async_compose<token_t, void(beast::error_code, std::size_t)>(
+                framed_read_op<stream_type, dynamic_buffer_t>{m_stream, m_in_header, buffer}
+                , token
+                , m_stream
+        );
+    }
+
+    //--------------------------------------------------------------------------
+    // Writes a complete message, preceded by its length
+    template<typename const_buffers_t, typename token_t>
+    auto async_write(const const_buffers_t &buffers, token_t &&token) {
+        m_out_header = boost::endian::native_to_little(std::uint64_t(net::buffer_size(buffers)));
+
+        return net::async_write(
+                m_stream
+                , beast::buffers_cat(net::buffer(&m_out_header, sizeof(m_out_header)), buffers)
+                , std::forward<token_t>(token)
+        );
+    }
+
+    //--------------------------------------------------------------------------
+
+    bool is_open() const {
+        return m_stream.socket().is_open();
+    }
+
+    // Orderly shutdown of the connection. Throws on error
+    void close() {
+        m_stream.socket().shutdown(protocol_t::socket::shutdown_both);
+        m_stream.socket().close();
+    }
+
+    // Shutdown of the connection after a failure on our side
+    void close_on_error() {
+        beast::error_code ec;
+        m_stream.socket().shutdown(protocol_t::socket::shutdown_both, ec);
+        m_stream.socket().close(ec);
+    }
+
+    // Closes the socket without a shutdown. Pending operations complete with an error
+    void abort() {
+        beast::error_code ec;
+        m_stream.socket().close(ec);
+    }
+
+private:
+    //--------------------------------------------------------------------------
+
+    void configure() {
+        // Messages are written in a single operation, so there is no
+        // point in having the kernel wait for more data
+        if constexpr (std::is_same_v<protocol_t, tcp>) {
+            m_stream.socket().set_option(tcp::no_delay(true));
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    // Data
+
+    stream_type m_stream;
+    std::optional<tcp::resolver> m_resolver; ///< Only needed on the client side of tcp connections
+
+    std::uint64_t m_in_header = 0; ///< Receives the length of incoming messages
+    std::uint64_t m_out_header = 0; ///< Holds the length of outgoing messages during a write
+};
+
+/******************************************************************************************/
+////////////////////////////////////////////////////////////////////////////////////////////
+/******************************************************************************************/
+/**
+ * The shared-memory transport is meant for clients running on the same machine as the server.
+ * A unix domain socket carries length-prefixed control messages only. Each session owns a
+ * shared-memory segment holding one ring buffer per direction. Message bytes are copied once
+ * into the ring of the sender, and only a descriptor (position and length) is passed through
+ * the socket. The receiver copies the message out of the ring into its own buffer and marks
+ * the space as free. Messages that do not fit into the free space of the ring are sent inline
+ * through the socket instead, so correctness does not depend on the ring size.
+ */
+
+/** @brief The control information at the start of each ring in the shared-memory segment */
+struct shm_ring_header {
+    std::atomic<std::uint64_t> read_position{0}; ///< Total number of bytes consumed by the reader
+    char padding[56]; ///< Keeps the two ring headers on separate cache lines
+};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "shm_transport needs lock-free 64 bit atomics");
+
+/** @brief Tags of the control messages of shm_transport */
+enum class shm_message_tag : char {
+    DESCRIPTOR = 'D', INLINE = 'I'
+};
+
+/******************************************************************************************/
+/**
+ * Reads a control message and retrieves the message it describes from the ring (or from the
+ * control message itself, if it was sent inline). Used by shm_transport through net::async_compose.
+ */
+template<typename transport_t, typename dynamic_buffer_t>
+struct shm_read_op {
+    transport_t &m_transport;
+    dynamic_buffer_t &m_buffer;
+
+    bool m_started = false;
+
+    template<typename self_t>
+    void operator()(self_t &self, beast::error_code ec = {}, std::size_t /* bytes_transferred */ = 0) {
+        if (!m_started) {
+            m_started = true;
+            m_transport.m_control_buffer.clear();
+            return m_transport.m_control.async_read(m_transport.m_control_buffer, std::move(self));
+        }
+
+        if (ec) return self.complete(ec, 0);
+
+        auto control = m_transport.m_control_buffer.data();
+        if (control.size() < 1) return self.complete(net::error::invalid_argument, 0);
+        auto tag = static_cast<shm_message_tag>(*static_cast<const char *>(control.data()));
+
+        std::size_t message_size = 0;
+        if (shm_message_tag::INLINE == tag) {
+            message_size = control.size() - 1;
+            auto target = m_buffer.prepare(message_size);
+            net::buffer_copy(target, control + 1);
+        } else if (shm_message_tag::DESCRIPTOR == tag && control.size() == 1 + 2 * sizeof(std::uint64_t)) {
+            std::uint64_t descriptor[2];
+            std::memcpy(descriptor, static_cast<const char *>(control.data()) + 1, sizeof(descriptor));
+            auto position = boost::endian::little_to_native(descriptor[0]);
+            message_size = boost::endian::little_to_native(descriptor[1]);
+
+            // Descriptors come from the peer. They must describe the next message in the ring, which
+            // lies within the ring, or reading it would leave the ring (or the mapping).
+            if (0 == m_transport.m_ring_size || message_size > m_transport.m_ring_size
+                || position != m_transport.inbound_ring_header().read_position.load(std::memory_order_relaxed)) {
+                return self.complete(net::error::invalid_argument, 0);
+            }
+
+            auto target = m_buffer.prepare(message_size);
+            net::buffer_copy(target, m_transport.inbound_ring_buffers(position, message_size));
+
+            // The space in the ring may now be reused by the writer
+            m_transport.inbound_ring_header().read_position.store(position + message_size, std::memory_order_release);
+        } else {
+            return self.complete(net::error::invalid_argument, 0);
+        }
+
+        m_buffer.commit(message_size);
+        self.complete(ec, message_size);
+    }
+};
+
+/******************************************************************************************/
+/**
+ * Exchanges the name of the shared-memory segment between server and client. The server sends the
+ * name and waits for an acknowledgement, after which the name may be removed from the system.
+ * Used by shm_transport through net::async_compose.
+ */
+template<typename transport_t>
+struct shm_handshake_op {
+    transport_t &m_transport;
+    std::string m_host; ///< Only needed on the client side
+
+    enum class state { starting, connected, exchanging, acknowledging } m_state = state::starting;
+
+    template<typename self_t>
+    void operator()(self_t &self, beast::error_code ec = {}, std::size_t /* bytes_transferred */ = 0) {
+        auto &control = m_transport.m_control;
+        auto is_server = m_transport.m_is_server;
+
+        switch (m_state) {
+            case state::starting: {
+                // Let the control connection do its own preparations
+                m_state = state::connected;
+                if (is_server) return control.async_accept(std::move(self));
+                else return control.async_handshake(m_host, std::move(self));
+            }
+
+            case state::connected: {
+                if (ec) return self.complete(ec);
+
+                m_state = state::exchanging;
+                if (is_server) {
+                    // Let the client know where to find the segment
+                    return control.async_write(net::buffer(m_transport.m_segment_name), std::move(self));
+                } else {
+                    // Wait for the name of the segment
+                    m_transport.m_control_buffer.clear();
+                    return control.async_read(m_transport.m_control_buffer, std::move(self));
+                }
+            }
+
+            case state::exchanging: {
+                if (ec) return self.complete(ec);
+
+                m_state = state::acknowledging;
+                if (is_server) {
+                    // Wait for the client to attach to the segment
+                    m_transport.m_control_buffer.clear();
+                    return control.async_read(m_transport.m_control_buffer, std::move(self));
+                } else {
+                    try {
+                        m_transport.attach(beast::buffers_to_string(m_transport.m_control_buffer.data()));
+                    } catch (const boost::interprocess::interprocess_exception &) {
+                        return self.complete(net::error::not_found);
+                    }
+                    return control.async_write(net::buffer(m_transport.m_segment_name), std::move(self));
+                }
+            }
+
+            case state::acknowledging: {
+                // Both sides are attached, the name is no longer needed
+                if (!ec && is_server) boost::interprocess::shared_memory_object::remove(m_transport.m_segment_name.c_str());
+                return self.complete(ec);
+            }
+        }
+    }
+};
+
+/******************************************************************************************/
+
+class shm_transport {
+    template<typename, typename> friend struct shm_read_op;
+    template<typename> friend struct shm_handshake_op;
+
+public:
+    using protocol_type = local_stream;
+    using executor_type = framed_transport<local_stream>::executor_type;
+
+    //--------------------------------------------------------------------------
+    // Used on the server side, where we take ownership of an accepted socket
+    // and create the shared-memory segment holding the rings
+    shm_transport(local_stream::socket &&socket, std::size_t ring_size)
+        : m_control(std::move(socket))
+        , m_is_server(true)
+        , m_ring_size(ring_size)
+    {
+        static std::atomic<std::size_t> segment_counter{0};
+        m_segment_name = "estray_" + std::to_string(::getpid()) + "_" + std::to_string(segment_counter++);
+
+        namespace bip = boost::interprocess;
+        bip::shared_memory_object::remove(m_segment_name.c_str());
+        bip::shared_memory_object segment(bip::create_only, m_segment_name.c_str(), bip::read_write);
+        segment.truncate(bip::offset_t(2 * (sizeof(shm_ring_header) + m_ring_size)));
+        m_region = bip::mapped_region(segment, bip::read_write);
+
+        new(&ring_header(0)) shm_ring_header();
+        new(&ring_header(1)) shm_ring_header();
+    }
+
+    // Used on the client side, where the connection is yet to be made.
+    // The ring size is determined by the server.
+    template<typename executor_t>
+    explicit shm_transport(const executor_t &executor)
+        : m_control(executor)
+        , m_is_server(false)
+    { /* nothing */ }
+
+    shm_transport(shm_transport &&cp) noexcept
+        : m_control(std::move(cp.m_control))
+        , m_control_buffer(std::move(cp.m_control_buffer))
+        , m_is_server(cp.m_is_server)
+        , m_segment_name(std::exchange(cp.m_segment_name, std::string()))
+        , m_region(std::move(cp.m_region))
+        , m_ring_size(cp.m_ring_size)
+        , m_write_position(cp.m_write_position)
+    { /* nothing */ }
+
+    ~shm_transport() {
+        // Makes sure the segment does not outlive the server if the client never attached
+        if (m_is_server && !m_segment_name.empty()) {
+            boost::interprocess::shared_memory_object::remove(m_segment_name.c_str());
+        }
+    }
+
+    //--------------------------------------------------------------------------
+
+    executor_type get_executor() {
+        return m_control.get_executor();
+    }
+
+    //--------------------------------------------------------------------------
+    // Establishes the connection to the socket at the given path (client side)
+    template<typename token_t>
+    auto async_connect(const std::string &path, unsigned short port, token_t &&token) {
+        return m_control.async_connect(path, port, std::forward<token_t>(token));
+    }
+
+    //--------------------------------------------------------------------------
+    // Hands the segment to the client (server side)
+    template<typename token_t>
+    auto async_accept(token_t &&token) {
+        return net::async_compose<token_t, void(beast::error_code)>(
+                shm_handshake_op<shm_transport>{*this, std::string()}, token, m_control
+        );
+    }
+
+    //--------------------------------------------------------------------------
+    // Attaches to the segment created by the server (client side)
+    template<typename token_t>
+    auto async_handshake(const std::string &host, token_t &&token) {
+        return net::async_compose<token_t, void(beast::error_code)>(
+                shm_handshake_op<shm_transport>{*this, host}, token, m_control
+        );
+    }
+
+    //--------------------------------------------------------------------------
+    // Reads a complete message into the buffer
+    template<typename dynamic_buffer_t, typename token_t>
+    auto async_read(dynamic_buffer_t &buffer, token_t &&token) {
+        return net::async_compose<token_t, void(beast::error_code, std::size_t)>(
+                shm_read_op<shm_transport, dynamic_buffer_t>{*this, buffer}
+                , token
+                , m_control
+        );
+    }
+
+    //--------------------------------------------------------------------------
+    // Copies the message into the ring and sends its descriptor. Messages not fitting
+    // into the free space of the ring are sent inline through the socket.
+    template<typename const_buffers_t, typename token_t>
+    auto async_write(const const_buffers_t &buffers, token_t &&token) {
+        auto message_size = std::uint64_t(net::buffer_size(buffers));
+        auto free_space = m_ring_size - (m_write_position - outbound_ring_header().read_position.load(std::memory_order_acquire));
+
+        if (0 == m_ring_size || message_size > free_space) {
+            m_out_tag = static_cast<char>(shm_message_tag::INLINE);
+            return m_control.async_write(beast::buffers_cat(net::buffer(&m_out_tag, 1), buffers), std::forward<token_t>(token));
+        }
+
+        net::buffer_copy(outbound_ring_buffers(m_write_position, message_size), buffers);
+
+        m_out_tag = static_cast<char>(shm_message_tag::DESCRIPTOR);
+        m_out_descriptor[0] = boost::endian::native_to_little(m_write_position);
+        m_out_descriptor[1] = boost::endian::native_to_little(message_size);
+        m_write_position += message_size;
+
+        return m_control.async_write(
+                beast::buffers_cat(net::buffer(&m_out_tag, 1), net::buffer(m_out_descriptor, sizeof(m_out_descriptor)))
+                , std::forward<token_t>(token)
+        );
+    }
+
+    //--------------------------------------------------------------------------
+
+    bool is_open() const {
+        return m_control.is_open();
+    }
+
+    // Orderly shutdown of the connection. Throws on error
+    void close() {
+        m_control.close();
+    }
+
+    // Shutdown of the connection after a failure on our side
+    void close_on_error() {
+        m_control.close_on_error();
+    }
+
+    // Closes the control connection. Pending operations complete with an error
+    void abort() {
+        m_control.abort();
+    }
+
+private:
+    //--------------------------------------------------------------------------
+
+    void attach(const std::string &segment_name) {
+        namespace bip = boost::interprocess;
+        bip::shared_memory_object segment(bip::open_only, segment_name.c_str(), bip::read_write);
+        m_region = bip::mapped_region(segment, bip::read_write);
+        m_ring_size = m_region.get_size() / 2 - sizeof(shm_ring_header);
+        m_segment_name = segment_name;
+    }
+
+    // Ring 0 carries messages from server to client, ring 1 from client to server
+    shm_ring_header &ring_header(std::size_t ring) {
+        return *reinterpret_cast<shm_ring_header *>(
+                static_cast<char *>(m_region.get_address()) + ring * (sizeof(shm_ring_header) + m_ring_size)
+        );
+    }
+
+    char *ring_data(std::size_t ring) {
+        return reinterpret_cast<char *>(&ring_header(ring)) + sizeof(shm_ring_header);
+    }
+
+    shm_ring_header &outbound_ring_header() { return ring_header(m_is_server ? 0 : 1); }
+    shm_ring_header &inbound_ring_header() { return ring_header(m_is_server ? 1 : 0); }
+
+    // The (at most two) contiguous areas of a ring holding size bytes from a given position
+    std::array<net::mutable_buffer, 2> ring_buffers(std::size_t ring, std::uint64_t position, std::uint64_t size) {
+        auto offset = std::size_t(position % m_ring_size);
+        auto first = std::min<std::size_t>(size, m_ring_size - offset);
+        return {
+                net::mutable_buffer(ring_data(ring) + offset, first)
+                , net::mutable_buffer(ring_data(ring), size - first)
+        };
+    }
+
+    std::array<net::mutable_buffer, 2> outbound_ring_buffers(std::uint64_t position, std::uint64_t size) {
+        return ring_buffers(m_is_server ? 0 : 1, position, size);
+    }
+
+    std::array<net::mutable_buffer, 2> inbound_ring_buffers(std::uint64_t position, std::uint64_t size) {
+        return ring_buffers(m_is_server ? 1 : 0, position, size);
+    }
+
+    //--------------------------------------------------------------------------
+    // Data
+
+    framed_transport<local_stream> m_control; ///< Carries descriptors and the handshake
+    beast::flat_buffer m_control_buffer; ///< Receives control messages
+
+    bool m_is_server;
+    std::string m_segment_name;
+    boost::interprocess::mapped_region m_region;
+    std::size_t m_ring_size = 0;
+
+    std::uint64_t m_write_position = 0; ///< Total number of bytes written to the outbound ring
+    char m_out_tag = 0; ///< Holds the tag of an outgoing control message during a write
+    std::uint64_t m_out_descriptor[2] = {0, 0}; ///< Holds an outgoing descriptor during a write
+};
+
+/******************************************************************************************/
+////////////////////////////////////////////////////////////////////////////////////////////
+/******************************************************************************************/
@@ -0,0 +1,216 @@
+/**
+ * @file workload.hpp
+ */
+
+/*
+ * The following license applies to the code in this file:
+ *
+ * **************************************************************************
+ *
+ * Boost Software License - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished to
+ * do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part, and
+ * all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated by
+ * a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * **************************************************************************
+ *
+ * Author: Dr. Rüdiger Berlich of Gemfony scientific UG (haftungsbeschraenkt)
+ * See http://www.gemfony.eu for further information.
+ *
+ * This code is based on the Beast Websocket library by Vinnie Falco.
+ */
+
+#pragma once
+
+/******************************************************************************************/
+/*
+ * Recording and replay of workloads. A workload file starts with WORKLOADFILEMAGIC, followed
+ * by one record per payload: its size as an 8-byte little-endian number and the payload in
+ * the format of to_binary(). Records are appended as payloads are produced, so files may be
+ * read while they are still being written. Replaying starts over at the beginning once the
+ * end has been reached.
+ */
+
+// Standard headers go here
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+// Boost headers go here
+#include <boost/endian/conversion.hpp>
+
+// Our own headers go here
+#include "payload.hpp"
+
+/******************************************************************************************/
+
+const char WORKLOADFILEMAGIC[] = "#ESTWKL#";
+const std::size_t WORKLOADFILEMAGICLENGTH = sizeof(WORKLOADFILEMAGIC) - 1;
+
+/** @brief The largest record we are willing to read (protects against corrupt files) */
+const std::uint64_t MAXWORKLOADRECORDSIZE = std::uint64_t(1) << 32;
+
+/******************************************************************************************/
+////////////////////////////////////////////////////////////////////////////////////////////
+/******************************************************************************************/
+/**
+ * Appends payloads to a workload file. May be used by several producer threads at once.
+ */
+class workload_recorder {
+public:
+    explicit workload_recorder(const std::string &path)
+        : m_stream(path, std::ios::out | std::ios::binary | std::ios::trunc)
+    {
+        if (!m_stream) {
+            throw std::runtime_error("workload_recorder: Could not open " + path + " for writing");
+        }
+
+        m_stream.write(WORKLOADFILEMAGIC, WORKLOADFILEMAGICLENGTH);
+    }
+
+    workload_recorder(const workload_recorder &) = delete;
+    workload_recorder &operator=(const workload_recorder &) = delete;
+
+    /**
+     * Appends a payload. Returns false if it could not be written (e.g. because the disk is
+     * full). The recording is incomplete then, and all further calls fail as well. Called by
+     * producer threads, so errors are not thrown.
+     */
+    bool record(const payload_base *payload_ptr) {
+        // Serialization happens outside of the lock
+        auto record = to_binary(payload_ptr);
+        auto size = boost::endian::native_to_little(std::uint64_t(record.size()));
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_failed) return false;
+
+        m_stream.write(reinterpret_cast<const char *>(&size), sizeof(size));
+        m_stream.write(record.data(), static_cast<std::streamsize>(record.size()));
+        if (!m_stream) {
+            m_failed = true;
+            return false;
+        }
+        m_n_records++;
+        return true;
+    }
+
+    std::size_t get_n_records() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_n_records;
+    }
+
+    /** @brief Whether a record could not be written */
+    bool failed() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_failed;
+    }
+
+private:
+    mutable std::mutex m_mutex;
+    std::ofstream m_stream;
+    std::size_t m_n_records = 0;
+    bool m_failed = false;
+};
+
+/******************************************************************************************/
+////////////////////////////////////////////////////////////////////////////////////////////
+/******************************************************************************************/
+/**
+ * Reads payloads from a workload file in the order they were recorded. Not thread-safe.
+ */
+class workload_reader {
+public:
+    explicit workload_reader(const std::string &path)
+        : m_stream(path, std::ios::in | std::ios::binary)
+        , m_path(path)
+    {
+        if (!m_stream) {
+            throw std::runtime_error("workload_reader: Could not open " + path + " for reading");
+        }
+
+        char magic[WORKLOADFILEMAGICLENGTH];
+        m_stream.read(magic, WORKLOADFILEMAGICLENGTH);
+        if (!m_stream || 0 != std::memcmp(magic, WORKLOADFILEMAGIC, WORKLOADFILEMAGICLENGTH)) {
+            throw std::runtime_error("workload_reader: " + path + " is not a workload file");
+        }
+
+        if (!read_record()) {
+            throw std::runtime_error("workload_reader: " + path + " does not contain any payloads");
+        }
+    }
+
+    workload_reader(const workload_reader &) = delete;
+    workload_reader &operator=(const workload_reader &) = delete;
+
+    /** @brief Retrieves the next payload. Starts over at the beginning of the file when its end is reached */
+    payload_base *next() {
+        if (!m_record_available) {
+            m_stream.clear();
+            m_stream.seekg(WORKLOADFILEMAGICLENGTH);
+            m_n_passes++;
+
+            if (!read_record()) {
+                throw std::runtime_error("workload_reader::next(): Could not read from " + m_path);
+            }
+        }
+
+        auto *payload_ptr = from_binary(m_record);
+        m_record_available = read_record(); // Prefetch, so we know about the end of the file
+        return payload_ptr;
+    }
+
+    /** @brief The number of times the reader had to start over */
+    std::size_t get_n_passes() const {
+        return m_n_passes;
+    }
+
+private:
+    // Reads the next record into m_record. Returns false at the end of the file
+    bool read_record() {
+        std::uint64_t size = 0;
+        if (!m_stream.read(reinterpret_cast<char *>(&size), sizeof(size))) return false;
+
+        size = boost::endian::little_to_native(size);
+        if (size > MAXWORKLOADRECORDSIZE) {
+            throw std::runtime_error("workload_reader: Invalid record size " + std::to_string(size) + " in " + m_path);
+        }
+
+        m_record.resize(size);
+        if (!m_stream.read(m_record.data(), static_cast<std::streamsize>(size))) {
+            // A truncated record, e.g. because the file is still being written
+            return false;
+        }
+
+        return true;
+    }
+
+    std::ifstream m_stream;
+    std::string m_path;
+    std::string m_record; ///< The record to be returned by the next call to next()
+    bool m_record_available = true;
+    std::size_t m_n_passes = 0;
+};
+
+/******************************************************************************************/